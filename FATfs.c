@@ -17,10 +17,378 @@
 /*******************************************************************************
  * Includes
  ******************************************************************************/
+#include <ctype.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "FATfs.h"
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+
+#define FATFS_FAT12_MAX_CLUSTERS 4085U /* Volumes with fewer clusters than this are FAT12 */
+#define FATFS_FAT16_MAX_CLUSTERS 65525U /* Volumes with fewer clusters than this are FAT16, otherwise FAT32 */
+
+#define FATFS_FAT12_END_OF_CHAIN 0xFF7U /* FAT12 entries at or above this value end a cluster chain */
+#define FATFS_FAT16_END_OF_CHAIN 0xFFF7U /* FAT16 entries at or above this value end a cluster chain */
+#define FATFS_FAT32_END_OF_CHAIN 0x0FFFFFF7U /* FAT32 entries at or above this value end a cluster chain */
+#define FATFS_EXFAT_END_OF_CHAIN 0xFFFFFFF7U /* exFAT entries at or above this value end a cluster chain */
+
+#define FATFS_DIRECTORY_ENTRY_SIZE 32U /* Size of one directory entry in bytes */
+#define FATFS_SCAN_GROUP_ENTRIES 16U /* Number of directory entries classified by one step of the scan kernel */
+
+#define FATFS_DECODE_SKIP 0U /* The decoded directory entry is not listed (deleted, long name, the directory itself) */
+#define FATFS_DECODE_ENTRY 1U /* The decoded directory entry is listed */
+#define FATFS_DECODE_END 2U /* The end-of-directory marker was found */
+
+#define FATFS_DIR_ARRAY_INITIAL_CAPACITY 16U /* Number of entries allocated when a directory array is created */
+
+#define FATFS_NAME_KEY_LENGTH 11U /* Length of a name padded like an 8.3 directory entry */
+
+#define FATFS_LFN_ATTRIBUTE 0x0FU /* Attribute byte of a VFAT long file name entry */
+#define FATFS_DELETED_ENTRY 0xE5U /* First byte of a deleted directory entry */
+#define FATFS_LFN_LAST_ENTRY_FLAG 0x40U /* Sequence number flag of the entry holding the end of a long file name */
+#define FATFS_LFN_SEQUENCE_MASK 0x1FU /* Bits of the sequence number of a long file name entry */
+#define FATFS_LFN_CHARACTERS_PER_ENTRY 13U /* Number of UTF-16 characters in one long file name entry */
+#define FATFS_LFN_MAX_ENTRIES 20U /* Maximum number of entries of a long file name */
+#define FATFS_LONG_NAME_MAX_UNITS (FATFS_LFN_MAX_ENTRIES * FATFS_LFN_CHARACTERS_PER_ENTRY) /* Room for the UTF-16 characters of a long name */
+#define FATFS_LONG_NAME_MAX_BYTES (3U * FATFS_LONG_NAME_MAX_UNITS) /* Room for a long name converted to UTF-8 */
+#define FATFS_NAME_BLOCK_SIZE 4096U /* Size of one block of a name arena */
+#define FATFS_DENTRY_CACHE_SIZE 256U /* Number of slots of the dentry cache, a power of two */
+#define FATFS_DIR_CACHE_SLOTS 8U /* Number of directory listings kept with their name index */
+#define FATFS_DIR_INDEX_MINIMUM_SIZE 16U /* Smallest number of slots of a directory name index, a power of two */
+#define FATFS_FINGERPRINT_SLOTS 8U /* Number of directories whose decoded entries are kept with the fingerprints of their clusters */
+#define FATFS_FINGERPRINT_INITIAL_CLUSTERS 8U /* Number of cluster fingerprints allocated when a directory is first read */
+#define FATFS_FINGERPRINT_LFN_ACTIVE 0x01U /* Fingerprint flag: a long file name was being collected at the end of the cluster */
+#define FATFS_FINGERPRINT_END 0x02U /* Fingerprint flag: the cluster holds the end-of-directory marker */
+#define FATFS_FIND_MAX_DEPTH 32U /* Number of directory levels searched by fatfs_find */
+#define FATFS_SHORT_NAME_MAX_LENGTH 12U /* Length of the longest "NAME.EXT" name */
+#define FATFS_SORT_KEY_BYTES 19U /* Bytes of a packed sort key: 3 of extension, 8 of name, then 8 of primary key */
+#define FATFS_RECOVERY_READ_SIZE (64U * 1024U) /* Number of bytes read at once by the deleted entry scan */
+#define FATFS_READ_NODE_MAX_SIZE (64U * 1024U * 1024U) /* Largest number of bytes read into one node of a cluster list */
+#define FATFS_STREAM_MAX_SIZE ((SIZE_MAX < UINT32_MAX) ? (uint64_t)SIZE_MAX : (uint64_t)UINT32_MAX) /* Largest exFAT stream read into one buffer */
+#define FATFS_SNAPSHOT_SUFFIX ".snap" /* Suffix of the mount snapshot stored beside the image */
+#define FATFS_SNAPSHOT_MAGIC "FATFSNAP" /* First bytes of a mount snapshot */
+#define FATFS_SNAPSHOT_VERSION 3U /* Layout version of a mount snapshot */
+#define FATFS_SNAPSHOT_HASH_BASIS 14695981039346656037ULL /* Initial value of the 64-bit FNV-1a hashes of a mount snapshot */
+#define FATFS_DAYS_FROM_1970_TO_1980 3652U /* Number of days from the Unix epoch to 1980-01-01, the first day of FAT dates */
+#define FATFS_SECONDS_PER_DAY 86400U /* Number of seconds in a day */
+#define FATFS_DATE_TABLE_SIZE 2048U /* One slot per value of the 7 year bits and 4 month bits of a FAT date (date >> 5) */
+#define FATFS_TIME_TABLE_SIZE 2048U /* One slot per value of the hour and minute bits of a FAT time */
+#define FATFS_FIND_MAX_PATH ((FATFS_FIND_MAX_DEPTH + 1U) * (FATFS_SHORT_NAME_MAX_LENGTH + 1U) + 1U) /* Room for the deepest path reported by fatfs_find */
+
+#define FATFS_DIR_CACHE_ENTRY(slot, probe) (&(slot)->Listing->entries[(slot)->Index[(probe)] - 1]) /* The entry an index slot refers to */
+
+#define FATFS_CHAIN_CACHE_DEFAULT_BUDGET (64U * 1024U) /* Default memory budget of the cluster chain cache in bytes */
+#define FATFS_CHAIN_CACHE_BUCKETS 256U /* Number of hash buckets of the cluster chain cache, a power of two */
+
+/* Decode the FAT12 entry of cluster n: two entries are packed into three bytes */
+#define FATFS_FAT12_ENTRY(n) ((0 == ((n) % 2)) ? (((uint32_t)(s_fat_table[(3 * (n)) / 2 + 1] & 0x0F) << 8) | s_fat_table[(3 * (n)) / 2]) \
+                                               : (((uint32_t)s_fat_table[(3 * (n)) / 2 + 1] << 4) | ((s_fat_table[(3 * (n)) / 2] & 0xF0) >> 4)))
+
+/* Decode the FAT16 entry of cluster n: one little-endian 16-bit word */
+#define FATFS_FAT16_ENTRY(n) ((uint32_t)s_fat_table[2 * (n)] | ((uint32_t)s_fat_table[2 * (n) + 1] << 8))
+
+/* Decode the FAT32 entry of cluster n: one little-endian 32-bit word, of which the upper 4 bits are reserved */
+#define FATFS_FAT32_ENTRY(n) (((uint32_t)s_fat_table[4 * (n)] | ((uint32_t)s_fat_table[4 * (n) + 1] << 8) |     \
+                               ((uint32_t)s_fat_table[4 * (n) + 2] << 16) | ((uint32_t)s_fat_table[4 * (n) + 3] << 24)) & \
+                              0x0FFFFFFFU)
+
+/* Decode the exFAT entry of cluster n: one little-endian 32-bit word */
+#define FATFS_EXFAT_ENTRY(n) ((uint32_t)s_fat_table[4 * (n)] | ((uint32_t)s_fat_table[4 * (n) + 1] << 8) | \
+                              ((uint32_t)s_fat_table[4 * (n) + 2] << 16) | ((uint32_t)s_fat_table[4 * (n) + 3] << 24))
+
+#define FATFS_EXFAT_ENTRY_END_OF_DIRECTORY 0x00U /* exFAT entry type marking the end of a directory */
+#define FATFS_EXFAT_ENTRY_ALLOCATION_BITMAP 0x81U /* exFAT entry type of the allocation bitmap */
+#define FATFS_EXFAT_ENTRY_FILE 0x85U /* exFAT entry type opening a file entry set */
+#define FATFS_EXFAT_ENTRY_STREAM_EXTENSION 0xC0U /* exFAT entry type holding the location and size of a file */
+#define FATFS_EXFAT_ENTRY_FILE_NAME 0xC1U /* exFAT entry type holding up to 15 characters of a file name */
+#define FATFS_EXFAT_ENTRY_IN_USE 0x80U /* Bit of the entry type set on every entry in use */
+#define FATFS_EXFAT_FLAG_NO_FAT_CHAIN 0x02U /* Stream extension flag: the clusters are contiguous and the FAT is not used */
+#define FATFS_EXFAT_NAME_CHARACTERS_PER_ENTRY 15U /* Number of UTF-16 characters in one file name entry */
+#define FATFS_EXFAT_MAX_NAME_LENGTH 255U /* Maximum number of characters in an exFAT file name */
+#define FATFS_EXFAT_MAX_CLUSTER_SHIFT 25U /* exFAT clusters are at most 32 MB */
+
+/*
+ * @brief Structure describing a stream (file or directory) seen while listing an exFAT directory.
+ * @details exFAT keeps the NoFatChain flag and the parent of a directory in the directory entry, not in the cluster chain,
+ *                so they are remembered by first cluster when the entry is decoded and looked up when the stream is read.
+ */
+typedef struct fatfs_exfat_stream_struct_t
+{
+    uint32_t First_cluster;  /* The first cluster of the stream, 0 if the slot is empty. */
+    uint32_t Cluster_count;  /* The number of clusters of a NoFatChain stream, 0 if the stream uses the FAT. */
+    uint32_t Parent_cluster; /* The first cluster of the directory containing the stream, 0 for the root directory. */
+} fatfs_exfat_stream_struct_t;
+
+/*
+ * @brief Structure describing a run of consecutive clusters of a chain.
+ */
+typedef struct fatfs_extent_struct_t
+{
+    uint32_t First_cluster; /* The first cluster of the run. */
+    uint32_t Cluster_count; /* The number of clusters in the run. */
+} fatfs_extent_struct_t;
+
+/*
+ * @brief Structure holding one decoded cluster chain in the chain cache.
+ * @details The chain is kept as a list of extents, so a contiguous file costs one extent whatever its size.
+ *                Entries are found through a hash bucket list and ordered by use in a doubly-linked LRU list.
+ */
+typedef struct fatfs_chain_cache_struct_t
+{
+    uint32_t First_cluster;                         /* The first cluster of the chain, the key of the entry. */
+    uint32_t Extent_count;                          /* The number of extents in Extents. */
+    uint32_t Memory_size;                           /* The number of bytes charged to the cache budget for this entry. */
+    struct fatfs_chain_cache_struct_t *Hash_next;   /* The next entry in the same hash bucket. */
+    struct fatfs_chain_cache_struct_t *Lru_prev;    /* The entry used just before this one, NULL for the most recent. */
+    struct fatfs_chain_cache_struct_t *Lru_next;    /* The entry used just after this one, NULL for the least recent. */
+    fatfs_extent_struct_t Extents[];                /* The extents of the chain, in chain order. */
+} fatfs_chain_cache_struct_t;
+
+/*
+ * Generate a cluster chain walker specialized for one FAT type.
+ * The entry decoder and the end-of-chain value are substituted at compile time, so the loop that follows
+ * the chain contains no per-entry dispatch on the FAT type. The walker stops at the end-of-chain marker,
+ * at a free or out-of-range entry, and after Cluster_count steps so that a looping chain cannot hang the reader.
+ */
+#define FATFS_DEFINE_CHAIN_WALKER(name, ENTRY, END_OF_CHAIN)                                           \
+    static uint32_t *name(uint32_t cluster, uint32_t *length)                                          \
+    {                                                                                                  \
+        uint32_t *chain = NULL;                                                                        \
+        uint32_t *grown = NULL;                                                                        \
+        uint32_t capacity = 0;                                                                         \
+        uint32_t count = 0;                                                                            \
+                                                                                                       \
+        while ((2 <= cluster) && (END_OF_CHAIN > cluster) &&                                           \
+               (s_FAT12Infor.Cluster_count + 2 > cluster) && (s_FAT12Infor.Cluster_count >= count))    \
+        {                                                                                              \
+            if (count == capacity)                                                                     \
+            {                                                                                          \
+                capacity = (0 == capacity) ? 16 : capacity * 2;                                        \
+                grown = (uint32_t *)realloc(chain, capacity * sizeof(uint32_t));                       \
+                if (NULL == grown)                                                                     \
+                {                                                                                      \
+                    free(chain);                                                                       \
+                    chain = NULL;                                                                      \
+                    count = 0;                                                                         \
+                    error_callback(DYNAMIC_ALLOCATON_ERROR);                                           \
+                    break;                                                                             \
+                }                                                                                      \
+                chain = grown;                                                                         \
+            }                                                                                          \
+            chain[count] = cluster;                                                                    \
+            count++;                                                                                   \
+            cluster = ENTRY(cluster);                                                                  \
+        }                                                                                              \
+                                                                                                       \
+        *length = count;                                                                               \
+        return chain;                                                                                  \
+    }
+
+/*
+ * @brief Structure assembling a VFAT long file name from its entries.
+ * @details The entries of a long name precede its short entry, last part first. The characters are collected
+ *                in place and converted to UTF-8 only when the short entry confirms the checksum.
+ */
+typedef struct fatfs_lfn_struct_t
+{
+    uint16_t Units[FATFS_LONG_NAME_MAX_UNITS];  /* The UTF-16 characters collected so far. */
+    uint32_t Unit_count;                        /* The number of characters the sequence can hold. */
+    uint8_t Checksum;                           /* The checksum of the short name recorded in the sequence. */
+    uint8_t Next_sequence;                      /* The sequence number of the next entry expected, 0 when the sequence is complete. */
+    uint8_t Active;                             /* Set while a sequence is being collected or is complete. */
+    char Name[FATFS_LONG_NAME_MAX_BYTES + 1];   /* The long name of the last entry decoded, in UTF-8. */
+} fatfs_lfn_struct_t;
+
+/*
+ * @brief Structure of one block of a name arena.
+ * @details Names are packed one after the other, so a directory with hundreds of long names needs a few allocations
+ *                and its names never move while the directory grows.
+ */
+typedef struct fatfs_name_block_struct_t
+{
+    struct fatfs_name_block_struct_t *Next; /* The block added before this one. */
+    uint32_t Used;                          /* The number of bytes used in Data. */
+    char Data[FATFS_NAME_BLOCK_SIZE];       /* The names, each terminated by '\0'. */
+} fatfs_name_block_struct_t;
+
+/*
+ * @brief Structure holding one resolved path component in the dentry cache.
+ * @details The cache is direct-mapped: a name hashes to exactly one slot, and a new name replaces whatever was there.
+ */
+typedef struct fatfs_dentry_struct_t
+{
+    uint8_t Valid;                               /* Set when the slot holds an entry. */
+    fatfs_name_key_struct_t Key;                 /* The packed 8.3 name. */
+    uint32_t Parent_cluster;                     /* The first cluster of the directory holding the entry, 0 for the root directory. */
+    fatfs_directory_entry_list_struct_t Entry;   /* The directory entry. */
+} fatfs_dentry_struct_t;
+
+/*
+ * @brief Structure holding a cached directory listing and its name index.
+ * @details The index is an open-addressing table with linear probing, kept at most half full. A slot holds the position
+ *                of an entry in the listing plus one, 0 meaning empty.
+ */
+typedef struct fatfs_dir_cache_struct_t
+{
+    uint32_t First_cluster; /* The first cluster of the directory, 0 for the root directory. */
+    uint32_t Generation;    /* The generation the directory was read in. */
+    uint32_t Last_used;     /* The value of the use clock when the listing was last used. */
+    DirArray *Listing;      /* The entries of the directory, NULL if the slot is empty. */
+    uint32_t *Index;        /* The name index, a power of two number of slots. */
+    uint32_t Index_size;    /* The number of slots in the name index. */
+} fatfs_dir_cache_struct_t;
+
+/*
+ * @brief Classification of a group of up to FATFS_SCAN_GROUP_ENTRIES directory entries.
+ * @details Bit k of each mask describes the k-th entry of the group. Every entry of the group is in exactly one of
+ *                Short, Lfn and End; Deleted may overlap with Short and Lfn.
+ */
+typedef struct fatfs_scan_masks_struct_t
+{
+    uint16_t Short;   /* Short entries, deleted or not. */
+    uint16_t Lfn;     /* Long file name entries, deleted or not. */
+    uint16_t Deleted; /* Entries whose first byte is the deleted marker. */
+    uint16_t End;     /* Free entries: the first one ends the directory. */
+} fatfs_scan_masks_struct_t;
+
+/*
+ * @brief Structure holding one open directory of the walk of fatfs_find.
+ * @details A directory of the tree index is read from its nodes, any other directory through an iterator.
+ */
+typedef struct fatfs_find_frame_struct_t
+{
+    DirIterator *Iterator; /* The iterator reading the directory, NULL when it is read from the tree index. */
+    uint32_t Next_child;   /* The node of the next entry, when the directory is read from the tree index. */
+    uint32_t Last_child;   /* The node after the last entry, when the directory is read from the tree index. */
+    uint32_t Path_length;  /* The length of the path of the directory. */
+} fatfs_find_frame_struct_t;
+
+/*
+ * @brief State of the deleted entry scan of fatfs_scan_deleted.
+ * @details Directories and Scanned are bitmaps with one bit per cluster, stored in one allocation.
+ */
+typedef struct fatfs_recovery_scan_struct_t
+{
+    uint8_t *Directories;         /* Clusters known to belong to a directory. */
+    uint8_t *Scanned;             /* Clusters already scanned as a directory. */
+    RecoveryCallback Callback;    /* The callback receiving the reports. */
+    void *Context;                /* The context passed to the callback. */
+    uint32_t Found;               /* The number of entries reported. */
+    fatfs_lfn_struct_t Lfn;       /* Never active: deleted entries are reported without long name. */
+} fatfs_recovery_scan_struct_t;
+
+/*
+ * @brief Structure holding the remembered disk usage of one directory.
+ */
+typedef struct fatfs_du_memo_struct_t
+{
+    uint32_t Key;                    /* The first cluster of the directory plus one, 0 if the slot is empty. */
+    fatfs_disk_usage_struct_t Usage; /* The totals of the directory. */
+} fatfs_du_memo_struct_t;
+
+/*
+ * @brief Structure holding one open directory of the walk of fatfs_disk_usage.
+ */
+typedef struct fatfs_du_frame_struct_t
+{
+    fatfs_find_frame_struct_t Walk;  /* The entries of the directory, read like a directory of fatfs_find. */
+    uint32_t Cluster;                /* The first cluster of the directory, 0 for the root directory. */
+    fatfs_disk_usage_struct_t Usage; /* The totals of the entries read so far. */
+} fatfs_du_frame_struct_t;
+
+/*
+ * @brief Structure holding the fingerprint of one cluster of a directory.
+ */
+typedef struct fatfs_cluster_fingerprint_struct_t
+{
+    uint64_t Hash;      /* The FNV-1a hash of the raw bytes of the cluster. */
+    uint32_t Entry_end; /* The number of entries decoded up to the end of the cluster. */
+    uint32_t Flags;     /* FATFS_FINGERPRINT_LFN_ACTIVE and FATFS_FINGERPRINT_END, as left by the end of the cluster. */
+} fatfs_cluster_fingerprint_struct_t;
+
+/*
+ * @brief Structure holding the decoded entries of a directory with the fingerprints of the clusters they were decoded from.
+ * @details The entries ending in a cluster depend only on that cluster and the ones before it, so as long as the clusters read again
+ *                hash to the same values from the first one on, their entries are copied from Listing instead of being decoded.
+ */
+typedef struct fatfs_dir_fingerprint_struct_t
+{
+    uint32_t First_cluster;                       /* The first cluster of the directory, 0 for the root directory. */
+    uint32_t Last_used;                           /* The value of the use clock when the entries were last used. */
+    uint32_t Cluster_count;                       /* The number of clusters read. */
+    fatfs_cluster_fingerprint_struct_t *Clusters; /* The fingerprint of every cluster read. */
+    DirArray *Listing;                            /* The entries of the directory, NULL if the slot is empty. */
+} fatfs_dir_fingerprint_struct_t;
+
+/*
+ * @brief Header of the mount snapshot file.
+ * @details The header is followed by the nodes of the tree index with Long_name cleared, one name offset per node
+ *                (the offset of the long name plus 1, 0 for none), then the long names each terminated by '\0'. The FAT is not stored.
+ *                The snapshot is used only if Image_size, Image_mtime, Image_mtime_nsec, Image_inode and Boot_hash still describe
+ *                the image, and Fat_hash matches the FAT read from it.
+ */
+typedef struct fatfs_snapshot_header_struct_t
+{
+    char Magic[8];            /* FATFS_SNAPSHOT_MAGIC, not terminated. */
+    uint32_t Version;         /* FATFS_SNAPSHOT_VERSION. */
+    uint32_t Node_size;       /* The size of one node, which changes with the layout of the structures. */
+    uint64_t Image_size;      /* The size of the image the snapshot was taken from. */
+    int64_t Image_mtime;      /* The modification time of the image the snapshot was taken from, in seconds. */
+    int64_t Image_mtime_nsec; /* The nanoseconds of the modification time of the image. */
+    uint64_t Image_inode;     /* The inode number of the image. */
+    uint64_t Boot_hash;       /* The FNV-1a hash of the boot sector of the image. */
+    uint64_t Fat_hash;        /* The FNV-1a hash of the FAT of the image. */
+    uint64_t Payload_hash;    /* The FNV-1a hash of everything after the header. */
+    uint32_t Fat_size;        /* The number of bytes of the FAT. */
+    uint32_t Node_count;      /* The number of nodes of the tree index. */
+    uint32_t Names_size;      /* The number of bytes of the long names. */
+    uint32_t Reserved;        /* Always 0. */
+} fatfs_snapshot_header_struct_t;
+
+/*
+ * @brief Structure holding the packed sort key of a directory entry.
+ * @details Name and Extension are the packed name of the entry, so comparing the integers compares the names.
+ *                The radix sort reads the key one byte at a time, from the least significant byte of Extension to the most significant byte of Primary.
+ */
+typedef struct fatfs_sort_key_struct_t
+{
+    uint64_t Primary;   /* The size, date and time, or extension the entries are sorted by, 0 when sorting by name. */
+    uint64_t Name;      /* The 8 characters of the name in upper case. */
+    uint32_t Extension; /* The 3 characters of the extension in upper case, 0 when sorting by extension. */
+    uint32_t Index;     /* The position of the entry before sorting. */
+} fatfs_sort_key_struct_t;
+
+/*
+ * @brief State of a directory being read one entry at a time.
+ * @details The iterator holds one cluster of a FAT directory (one cluster worth of sectors for the fixed root region)
+ *                and decodes it entry by entry, reading the next cluster only when the caller asks for more entries.
+ */
+struct DirIterator
+{
+    uint8_t *buffer;                             /* The raw entries of the part of the directory being decoded. */
+    uint32_t buffer_length;                      /* The number of bytes in buffer. */
+    uint32_t position;                           /* The offset in buffer of the next entry to decode. */
+    fatfs_extent_struct_t *extents;              /* The extents of a directory stored in a cluster chain. */
+    uint32_t extent_count;                       /* The number of extents. */
+    uint32_t extent_index;                       /* The extent holding the next cluster to read. */
+    uint32_t cluster_index;                      /* The position of the next cluster to read in its extent. */
+    uint32_t next_sector;                        /* The next sector of the fixed root directory region to read. */
+    uint32_t remaining_sectors;                  /* The number of sectors of the fixed root directory region left to read. */
+    uint32_t excluded_cluster;                   /* Entries pointing to this cluster are the directory itself, 0 to keep every entry. */
+    uint32_t directory_cluster;                  /* The first cluster of an exFAT directory, 0 once it has been read. */
+    uint32_t parent_cluster;                     /* The first cluster of an exFAT directory, 0 for the root directory. */
+    uint8_t dot_dot_pending;                     /* Set until the synthesized exFAT ".." entry has been returned. */
+    uint8_t end_of_directory;                    /* Set when no entry is left. */
+    fatfs_directory_entry_list_struct_t entry;   /* The entry returned by the last call to fatfs_readdir. */
+    fatfs_lfn_struct_t lfn;                      /* The long file name being assembled, and the long name of entry. */
+    fatfs_scan_masks_struct_t scan;              /* The entries of the scanned group not decoded yet. */
+    uint32_t scan_position;                      /* The offset in buffer of the first entry of the scanned group. */
+    fatfs_entry_view_struct_t view;              /* The view returned by the last call to fatfs_readdir_view. */
+    uint32_t loaded_count;                       /* The position in the directory of the cluster in buffer plus one. */
+    uint32_t next_offset;                        /* The offset in buffer following the last entry decoded. */
+};
 /*******************************************************************************
  * Variables
  ******************************************************************************/
@@ -40,19 +408,142 @@ static void (*error_callback)(ERROR_CODE);
 static uint16_t num_cluster_in_root_directory = 0;
 /* The number of clusters in the root directory. */
 
-static uint16_t cluster_started_in_physical_of_rootdirectory = 0;
+static uint32_t cluster_started_in_physical_of_rootdirectory = 0;
 /* The physical start of the root directory in clusters. */
 
-static uint16_t Cluster_starts_in_physical_of_the_data_area = 0;
+static uint32_t Cluster_starts_in_physical_of_the_data_area = 0;
 /* The physical start of the data area in clusters. */
 
+static const uint8_t s_fat_entry_bits[] = {12, 16, 32, 32};
+/* The width in bits of one FAT entry, indexed by FATFS_TYPE. */
+
+static const uint32_t s_fat_bad_cluster[] = {FATFS_FAT12_END_OF_CHAIN, FATFS_FAT16_END_OF_CHAIN, FATFS_FAT32_END_OF_CHAIN, FATFS_EXFAT_END_OF_CHAIN};
+/* The entry value marking a bad cluster, indexed by FATFS_TYPE. */
+
+static uint8_t *s_allocation_bitmap = NULL;
+/* The exFAT allocation bitmap, one bit per cluster of the cluster heap. */
+
+static uint32_t s_allocation_bitmap_size = 0;
+/* The number of bytes in the exFAT allocation bitmap. */
+
+static fatfs_exfat_stream_struct_t *s_exfat_streams = NULL;
+/* Open-addressing table of the exFAT streams seen so far, keyed by first cluster. */
+
+static uint32_t s_exfat_stream_capacity = 0;
+/* The number of slots in the exFAT stream table, always a power of two. */
+
+static uint32_t s_exfat_stream_count = 0;
+/* The number of used slots in the exFAT stream table. */
+
+static uint8_t s_boot_sector[KMC_DEFAULT_SECTOR_SIZE];
+/* Copy of the boot sector read at mount time, compared to detect a reformatted image. */
+
+static kmc_image_stamp_struct_t s_image_stamp;
+/* The stamp of the image when it was last checked. */
+
+static uint32_t s_generation = 0;
+/* Incremented every time a change to the image is detected. */
+
+static fatfs_chain_cache_struct_t *s_chain_cache_buckets[FATFS_CHAIN_CACHE_BUCKETS];
+/* Hash buckets of the cluster chain cache, keyed by first cluster. */
+
+static fatfs_chain_cache_struct_t *s_chain_cache_lru_head = NULL;
+/* The most recently used entry of the cluster chain cache. */
+
+static fatfs_chain_cache_struct_t *s_chain_cache_lru_tail = NULL;
+/* The least recently used entry of the cluster chain cache, evicted first. */
+
+static uint32_t s_chain_cache_size = 0;
+/* The number of bytes used by the cluster chain cache. */
+
+static uint32_t s_chain_cache_budget = FATFS_CHAIN_CACHE_DEFAULT_BUDGET;
+/* The maximum number of bytes the cluster chain cache may use. */
+
+static fatfs_dentry_struct_t s_dentry_cache[FATFS_DENTRY_CACHE_SIZE];
+/* The dentry cache, resolved path components keyed by parent cluster and name. */
+
+static uint32_t s_dentry_generation = 0;
+/* The generation the entries of the dentry cache were read in. */
+
+static fatfs_dir_cache_struct_t s_dir_cache[FATFS_DIR_CACHE_SLOTS];
+/* The directory listings kept with their name index, replaced least recently used first. */
+
+static uint32_t s_dir_cache_clock = 0;
+/* Incremented on every use of the directory cache, orders the listings by use. */
+
+static uint32_t s_mount_options = 0;
+/* The FATFS_MOUNT_ options the volume was mounted with. */
+
+static fatfs_tree_node_struct_t *s_tree_nodes = NULL;
+/* The tree index, every entry of the volume in one array, node 0 being the root directory. */
+
+static uint32_t s_tree_node_count = 0;
+/* The number of nodes in the tree index. */
+
+static uint32_t s_tree_node_capacity = 0;
+/* The number of nodes allocated for the tree index. */
+
+static uint32_t *s_tree_directories = NULL;
+/* Open-addressing table of the directory nodes of the tree index keyed by first cluster, a slot holds the node index plus one. */
+
+static uint32_t s_tree_directory_capacity = 0;
+/* The number of slots in the directory table, always a power of two. */
+
+static uint32_t s_tree_directory_count = 0;
+/* The number of directories in the directory table. */
+
+static fatfs_name_block_struct_t *s_tree_names = NULL;
+/* The long names of the entries of the tree index. */
+
+static fatfs_du_memo_struct_t *s_du_memo = NULL;
+/* The remembered disk usage of directories, an open addressing hash table keyed by first cluster. */
+
+static uint32_t s_du_memo_capacity = 0;
+/* The number of slots of the disk usage table, always a power of two. */
+
+static uint32_t s_du_memo_count = 0;
+/* The number of directories in the disk usage table. */
+
+static uint32_t s_du_memo_generation = 0;
+/* The generation the disk usage table was filled in. */
+
+static fatfs_dir_fingerprint_struct_t s_dir_fingerprints[FATFS_FINGERPRINT_SLOTS];
+/* The directories whose decoded entries are reused while their clusters are unchanged. */
+
+static uint32_t s_dir_fingerprint_clock = 0;
+/* The use clock of the directory fingerprints, incremented on every read. */
+
+static uint32_t s_date_days[FATFS_DATE_TABLE_SIZE];
+/* The number of days from the Unix epoch to the first of the month, indexed by the year and month bits of a FAT date. */
+
+static uint32_t s_time_seconds[FATFS_TIME_TABLE_SIZE];
+/* The number of seconds from midnight, indexed by the hour and minute bits of a FAT time. */
+
+static uint8_t s_timestamp_tables_ready = 0;
+/* Set once s_date_days and s_time_seconds have been filled. */
+
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
+static void tree_index_release(void);
+static uint32_t format_short_name(const char *file_name, const char *extension, char *name);
+static uint8_t tree_index_build(void);
+static uint8_t snapshot_load(void);
+static void snapshot_save(void);
 /*******************************************************************************
  * Code
  ******************************************************************************/
 
+/*
+ *@brief Get the position of a cluster in the image.
+ *@param cluster - The cluster number, 2 being the first cluster of the data area.
+ *@returns Returns the byte offset of the first sector of the cluster.
+ */
+static uint64_t get_cluster_offset(uint32_t cluster)
+{
+    return ((uint64_t)Cluster_starts_in_physical_of_the_data_area + (uint64_t)(cluster - 2) * s_FAT12Infor.sectors_per_cluster) * s_FAT12Infor.bytes_per_sector;
+}
+
 /*
  *@brief Retrieve the FAT (File Allocation Table).
  *@param None.
@@ -71,7 +562,7 @@ static void get_fat_table(void)
     if (NULL != s_fat_table)
     {
         /* Read multiple sectors from the FAT into the allocated memory */
-        number_of_bytes_read_in_FAT = kmc_read_multi_sector(s_FAT12Infor.bytes_per_sector * s_FAT12Infor.sectors_per_cluster, s_FAT12Infor.Sectors_per_FAT, s_fat_table);
+        number_of_bytes_read_in_FAT = kmc_read_multi_sector((uint64_t)s_FAT12Infor.bytes_per_sector * s_FAT12Infor.Reserved_sector_count, s_FAT12Infor.Sectors_per_FAT, s_fat_table);
 
         /* Check if the correct number of bytes were read */
         if (number_of_bytes_read_in_FAT != (s_FAT12Infor.Sectors_per_FAT) * (s_FAT12Infor.bytes_per_sector))
@@ -91,516 +582,6231 @@ static void get_fat_table(void)
     }
 }
 
+/* Chain walkers specialized for each FAT type */
+FATFS_DEFINE_CHAIN_WALKER(get_cluster_chain_fat12, FATFS_FAT12_ENTRY, FATFS_FAT12_END_OF_CHAIN)
+FATFS_DEFINE_CHAIN_WALKER(get_cluster_chain_fat16, FATFS_FAT16_ENTRY, FATFS_FAT16_END_OF_CHAIN)
+FATFS_DEFINE_CHAIN_WALKER(get_cluster_chain_fat32, FATFS_FAT32_ENTRY, FATFS_FAT32_END_OF_CHAIN)
+FATFS_DEFINE_CHAIN_WALKER(get_cluster_chain_exfat, FATFS_EXFAT_ENTRY, FATFS_EXFAT_END_OF_CHAIN)
+
 /*
- *@brief Retrieve the next entry in the FAT (File Allocation Table).
- *@param n - The index of the current FAT entry.
- *@returns Returns the next FAT entry.
+ *@brief Retrieve the FAT entry of a cluster.
+ *@param cluster - The cluster number, which must be inside the data area.
+ *@returns Returns the FAT entry, the number of the next cluster or an end-of-chain marker.
  */
-static uint16_t get_fat_entry_next(uint16_t n)
+static uint32_t get_fat_entry(uint32_t cluster)
 {
+    uint32_t entry = 0;
+    /* Variable to store the FAT entry */
 
-    uint16_t entry;
-    /* Variable to store the next FAT entry */
-
-    /* Check if the current index is even */
-    if (0 == n % 2)
+    /* Decode the entry with the decoder of the FAT type */
+    switch (s_FAT12Infor.Fat_type)
+    {
+    case FATFS_TYPE_FAT12:
     {
-        /* If it is, calculate the next FAT entry using the even index formula */
-        entry = (s_fat_table[(3 * n) / 2 + 1] & 0x0F) << 8 | s_fat_table[(3 * n) / 2];
+        entry = FATFS_FAT12_ENTRY(cluster);
+        break;
     }
-    else
+    case FATFS_TYPE_FAT16:
+    {
+        entry = FATFS_FAT16_ENTRY(cluster);
+        break;
+    }
+    case FATFS_TYPE_FAT32:
+    {
+        entry = FATFS_FAT32_ENTRY(cluster);
+        break;
+    }
+    case FATFS_TYPE_EXFAT:
     {
-        /* If it's not, calculate the next FAT entry using the odd index formula */
-        entry = s_fat_table[(3 * n) / 2 + 1] << 4 | (s_fat_table[(3 * n) / 2] & 0xF0) >> 4;
+        entry = FATFS_EXFAT_ENTRY(cluster);
+        break;
+    }
     }
 
     return entry;
 }
 
 /*
- *@brief Create a new node entry for a directory list.
- *@param None.
- *@returns Returns a pointer to the newly created node.
+ *@brief Retrieve the cluster chain that starts at a given cluster.
+ *@param first_cluster - The first cluster of the chain.
+ *@param length - Receives the number of clusters in the chain.
+ *@returns Returns an allocated array of cluster numbers, or NULL if the chain is empty. The caller frees it.
  */
-static DirList *createNodeEntry(void)
+static uint32_t *get_cluster_chain(uint32_t first_cluster, uint32_t *length)
 {
-    /* Allocate memory for the new node */
-    DirList *newNode = (DirList *)malloc(sizeof(DirList));
+    uint32_t *chain = NULL;
+    /* Variable to store the cluster chain */
 
-    /* Check if memory allocation was successful */
-    if (NULL == newNode)
+    /* Dispatch once per chain to the walker specialized for the FAT type */
+    switch (s_FAT12Infor.Fat_type)
     {
-        /* If memory allocation failed, call the error callback with the appropriate error code */
-        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    case FATFS_TYPE_FAT12:
+    {
+        chain = get_cluster_chain_fat12(first_cluster, length);
+        break;
     }
-    else
+    case FATFS_TYPE_FAT16:
     {
-        /* If memory allocation was successful, initialize the next pointer of the new node to NULL */
-        newNode->next = NULL;
+        chain = get_cluster_chain_fat16(first_cluster, length);
+        break;
+    }
+    case FATFS_TYPE_FAT32:
+    {
+        chain = get_cluster_chain_fat32(first_cluster, length);
+        break;
+    }
+    case FATFS_TYPE_EXFAT:
+    {
+        chain = get_cluster_chain_exfat(first_cluster, length);
+        break;
+    }
     }
 
-    return newNode;
+    return chain;
 }
 
 /*
- *@brief Create a new node for a cluster list.
- *@param None.
- *@returns Returns a pointer to the newly created node.
+ *@brief Get the hash bucket of a chain in the chain cache.
+ *@param first_cluster - The first cluster of the chain.
+ *@returns Returns the index of the bucket.
  */
-static ClusterList *createNodeCluster(void)
+static uint32_t chain_cache_bucket(uint32_t first_cluster)
 {
-    /* Allocate memory for the new node */
-    ClusterList *newNode = (ClusterList *)malloc(sizeof(ClusterList));
+    return ((first_cluster * 2654435761U) >> 16) & (FATFS_CHAIN_CACHE_BUCKETS - 1);
+}
 
-    /* Check if memory allocation was successful */
-    if (NULL == newNode)
+/*
+ *@brief Remove an entry from the chain cache and free it.
+ *@param entry - The entry to remove.
+ *@returns No return value.
+ */
+static void chain_cache_remove(fatfs_chain_cache_struct_t *entry)
+{
+    fatfs_chain_cache_struct_t **link = &s_chain_cache_buckets[chain_cache_bucket(entry->First_cluster)];
+    /* The link pointing to the entry in its hash bucket */
+
+    /* Unlink the entry from its hash bucket */
+    while (*link != entry)
     {
-        /* If memory allocation failed, call the error callback with the appropriate error code */
-        error_callback(DYNAMIC_ALLOCATON_ERROR);
+        link = &(*link)->Hash_next;
+    }
+    *link = entry->Hash_next;
+
+    /* Unlink the entry from the LRU list */
+    if (NULL != entry->Lru_prev)
+    {
+        entry->Lru_prev->Lru_next = entry->Lru_next;
     }
     else
     {
-        /* If memory allocation was successful, initialize the next pointer of the new node to NULL */
-        newNode->next = NULL;
+        s_chain_cache_lru_head = entry->Lru_next;
+    }
+    if (NULL != entry->Lru_next)
+    {
+        entry->Lru_next->Lru_prev = entry->Lru_prev;
+    }
+    else
+    {
+        s_chain_cache_lru_tail = entry->Lru_prev;
     }
 
-    return newNode;
+    s_chain_cache_size -= entry->Memory_size;
+    free(entry);
 }
 
 /*
- *@brief Parse the boot sector of a FAT12 file system.
- *@param buff - The buffer containing the boot sector data.
+ *@brief Evict the least recently used chains until an amount of memory fits in the budget.
+ *@param needed - The number of bytes that must fit in the budget.
  *@returns No return value.
  */
-static void parse_bootsector(uint8_t *buff)
+static void chain_cache_evict(uint32_t needed)
 {
-    /* Copy the bytes per sector,sectors per cluster,  number of FATs, maximum number of root directory entries,
-       total sector count, sectors per FAT value from the buffer to the FAT12 info structure */
-    memcpy(&s_FAT12Infor.bytes_per_sector, &buff[11], 2);
-    memcpy(&s_FAT12Infor.sectors_per_cluster, &buff[13], 1);
-    memcpy(&s_FAT12Infor.Number_of_FATs, &buff[16], 1);
-    memcpy(&s_FAT12Infor.Maximum_number_of_root_directory_entries, &buff[17], 2);
-    memcpy(&s_FAT12Infor.Total_sector_count, &buff[19], 2);
-    memcpy(&s_FAT12Infor.Sectors_per_FAT, &buff[22], 2);
+    while (NULL != s_chain_cache_lru_tail && s_chain_cache_size + needed > s_chain_cache_budget)
+    {
+        chain_cache_remove(s_chain_cache_lru_tail);
+    }
 }
 
 /*
- *@brief Initialize the FAT file system.
- *@param path - The path to the file system.
- *@param callback - The callback function for error handling.
- *@returns Returns the size of the cluster.
+ *@brief Remove every chain from the chain cache.
+ *@param None.
+ *@returns No return value.
  */
-uint32_t fatfs_init(const char *path, ErrorCallback callback)
+static void chain_cache_flush(void)
 {
-    uint32_t Cluster_size = 0;
-    /* Variable to store the size of the cluster */
-    uint32_t number_of_bytes_read = 0;
-    /* Variable to store the number of bytes read */
-    uint8_t *buff;
-    /* Buffer to store the data read from the file system */
+    while (NULL != s_chain_cache_lru_tail)
+    {
+        chain_cache_remove(s_chain_cache_lru_tail);
+    }
+}
 
-    /* Set the error callback function */
-    error_callback = callback;
-    /* Initialize the KMC with the given path */
-    if (0 != kmc_init(path))
+/*
+ *@brief Remove the cached chains that use a cluster in a given range.
+ *@param first_cluster - The first cluster of the range.
+ *@param last_cluster - The last cluster of the range.
+ *@returns No return value.
+ */
+static void chain_cache_invalidate(uint32_t first_cluster, uint32_t last_cluster)
+{
+    fatfs_chain_cache_struct_t *entry = s_chain_cache_lru_head;
+    /* The entry being checked */
+    fatfs_chain_cache_struct_t *next = NULL;
+    /* The entry checked after it */
+    uint32_t i = 0;
+    /* Loop counter over the extents */
+    uint8_t stale = 0;
+    /* Flag set when the chain uses a cluster of the range */
+
+    while (NULL != entry)
     {
-        /* Allocate memory for the buffer */
-        buff = (uint8_t *)calloc(KMC_DEFAULT_SECTOR_SIZE, sizeof(uint8_t));
+        next = entry->Lru_next;
+        stale = 0;
 
-        /* Check if memory allocation was successful */
-        if (NULL != buff)
+        /* The chain depends on the FAT entry of every cluster it uses */
+        for (i = 0; i < entry->Extent_count && 0 == stale; i++)
         {
-            /* Read the sector at index 0 into the buffer */
-            number_of_bytes_read = kmc_read_sector(0, buff);
-
-            /* Check if the correct number of bytes were read */
-            if (KMC_DEFAULT_SECTOR_SIZE != number_of_bytes_read)
+            if (entry->Extents[i].First_cluster <= last_cluster && entry->Extents[i].First_cluster + entry->Extents[i].Cluster_count > first_cluster)
             {
-                /* If reading the boot sector failed, call the error callback with the appropriate error code */
-                error_callback(BOOT_SECTOR_READ_ERROR);
+                stale = 1;
             }
             else
             {
-                /* Parse the boot sector data from the buffer */
-                parse_bootsector(buff);
-
-                /* Free the memory allocated for the buffer */
-                free(buff);
-
-                /* Update the sector size for the KMC */
-                if (0 != kmc_update_sector_size(s_FAT12Infor.bytes_per_sector))
-                {
-                    /* Retrieve the FAT table */
-                    get_fat_table();
-
-                    /* Calculate the size of the cluster */
-                    Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
-                    /* Calculate the number of clusters in the root directory */
-                    num_cluster_in_root_directory = (s_FAT12Infor.Maximum_number_of_root_directory_entries * 32) / s_FAT12Infor.bytes_per_sector;
-
-                    /* Calculate the physical start of the root directory in clusters */
-                    cluster_started_in_physical_of_rootdirectory = (s_FAT12Infor.Number_of_FATs * s_FAT12Infor.Sectors_per_FAT) + 1;
-
-                    /* Calculate the physical start of the data area in clusters */
-                    Cluster_starts_in_physical_of_the_data_area = s_FAT12Infor.Number_of_FATs * s_FAT12Infor.Sectors_per_FAT + num_cluster_in_root_directory + 1;
-                }
-                else
-                {
-                    /* If updating the sector size failed, call the error callback with the appropriate error code */
-                    error_callback(ERROR_UPDATING_SECTOR_SIZE);
-                }
+                /* Do nothing */
             }
         }
+
+        if (0 != stale)
+        {
+            chain_cache_remove(entry);
+        }
         else
         {
-            /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
-            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            /* Do nothing */
         }
-    }
-    else
-    {
-        /* If initializing the KMC failed, call the error callback with the appropriate error code */
-        error_callback(ERROR_OPENING_FILE);
-    }
 
-    return Cluster_size;
+        entry = next;
+    }
 }
 
 /*
- *@brief Read a directory from the FAT file system.
- *@param First_Logical_Directory_of_current - The first logical directory of the current directory.
- *@returns Returns a pointer to the head of the directory list.
+ *@brief Retrieve the extents of the cluster chain that starts at a given cluster, through the chain cache.
+ *@param first_cluster - The first cluster of the chain.
+ *@param extent_count - Receives the number of extents.
+ *@returns Returns an allocated array of extents, or NULL if the chain is empty. The caller frees it.
  */
-DirList *fatfs_read_dir(uint16_t First_Logical_Directory_of_current)
+static fatfs_extent_struct_t *get_cluster_extents(uint32_t first_cluster, uint32_t *extent_count)
 {
-    uint8_t *buff = NULL;
-    /* Buffer to store the data read from the file system */
+    fatfs_extent_struct_t *extents = NULL;
+    /* The extents returned to the caller */
+    fatfs_chain_cache_struct_t *entry = s_chain_cache_buckets[chain_cache_bucket(first_cluster)];
+    /* The cached chain, found by walking the hash bucket */
+    uint32_t *chain = NULL;
+    /* The cluster chain when it is not cached */
+    uint32_t chain_length = 0;
+    /* The number of clusters in the chain */
+    uint32_t count = 0;
+    /* The number of extents */
+    uint32_t memory_size = 0;
+    /* The number of bytes a cache entry for the chain uses */
     uint32_t i = 0;
-    /* Variables to store the loop counter */
-    uint32_t number_of_bytes_read = 0;
-    /* Variable to store the number of bytes read */
-    DirList *head = NULL;
-    /* the head of the cluster list*/
-    DirList *tail = NULL;
-    /* the tail of the cluster list */
-    DirList *newNode = NULL;
-    /* the new node of the cluster list */
+    /* Loop counter */
 
-    /* Check if the first logical directory is the root directory */
-    if (0 == First_Logical_Directory_of_current)
+    *extent_count = 0;
+
+    while (NULL != entry && entry->First_cluster != first_cluster)
     {
-        /* Allocate memory for the buffer */
-        buff = (uint8_t *)calloc((s_FAT12Infor.bytes_per_sector * s_FAT12Infor.sectors_per_cluster * num_cluster_in_root_directory), sizeof(uint8_t));
+        entry = entry->Hash_next;
+    }
 
-        /* Check if memory allocation was successful */
-        if (NULL != buff)
+    if (NULL != entry)
+    {
+        /* Cache hit: move the entry to the front of the LRU list */
+        if (NULL != entry->Lru_prev)
+        {
+            entry->Lru_prev->Lru_next = entry->Lru_next;
+            if (NULL != entry->Lru_next)
+            {
+                entry->Lru_next->Lru_prev = entry->Lru_prev;
+            }
+            else
+            {
+                s_chain_cache_lru_tail = entry->Lru_prev;
+            }
+            entry->Lru_prev = NULL;
+            entry->Lru_next = s_chain_cache_lru_head;
+            s_chain_cache_lru_head->Lru_prev = entry;
+            s_chain_cache_lru_head = entry;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        extents = (fatfs_extent_struct_t *)malloc(entry->Extent_count * sizeof(fatfs_extent_struct_t));
+        if (NULL != extents)
+        {
+            memcpy(extents, entry->Extents, entry->Extent_count * sizeof(fatfs_extent_struct_t));
+            *extent_count = entry->Extent_count;
+        }
+        else
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+    }
+    else
+    {
+        /* Cache miss: follow the FAT and merge consecutive clusters into extents */
+        chain = get_cluster_chain(first_cluster, &chain_length);
+
+        if (0 != chain_length)
+        {
+            extents = (fatfs_extent_struct_t *)malloc(chain_length * sizeof(fatfs_extent_struct_t));
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (NULL != extents)
+        {
+            for (i = 0; i < chain_length; i++)
+            {
+                if (0 != count && extents[count - 1].First_cluster + extents[count - 1].Cluster_count == chain[i])
+                {
+                    extents[count - 1].Cluster_count++;
+                }
+                else
+                {
+                    extents[count].First_cluster = chain[i];
+                    extents[count].Cluster_count = 1;
+                    count++;
+                }
+            }
+            *extent_count = count;
+
+            /* Keep the chain if it fits in the budget, evicting the least recently used chains */
+            memory_size = sizeof(fatfs_chain_cache_struct_t) + count * sizeof(fatfs_extent_struct_t);
+            if (memory_size <= s_chain_cache_budget)
+            {
+                chain_cache_evict(memory_size);
+                entry = (fatfs_chain_cache_struct_t *)malloc(memory_size);
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            if (NULL != entry)
+            {
+                entry->First_cluster = first_cluster;
+                entry->Extent_count = count;
+                entry->Memory_size = memory_size;
+                memcpy(entry->Extents, extents, count * sizeof(fatfs_extent_struct_t));
+                entry->Hash_next = s_chain_cache_buckets[chain_cache_bucket(first_cluster)];
+                s_chain_cache_buckets[chain_cache_bucket(first_cluster)] = entry;
+                entry->Lru_prev = NULL;
+                entry->Lru_next = s_chain_cache_lru_head;
+                if (NULL != s_chain_cache_lru_head)
+                {
+                    s_chain_cache_lru_head->Lru_prev = entry;
+                }
+                else
+                {
+                    s_chain_cache_lru_tail = entry;
+                }
+                s_chain_cache_lru_head = entry;
+                s_chain_cache_size += memory_size;
+            }
+            else
+            {
+                /* The chain is returned without being cached */
+            }
+        }
+        else if (0 != chain_length)
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Free the cluster chain */
+        free(chain);
+    }
+
+    return extents;
+}
+
+/*
+ *@brief Re-read the FAT and update only the sectors that changed.
+ *@param None.
+ *@returns Returns the number of FAT sectors that changed.
+ */
+static uint32_t refresh_fat_table(void)
+{
+    uint8_t *fresh_fat_table = NULL;
+    /* The FAT as currently stored in the image */
+    uint32_t number_of_bytes_read_in_FAT = 0;
+    /* Variable to store the number of bytes read in FAT */
+    uint32_t sector = 0;
+    /* Loop counter over the FAT sectors */
+    uint32_t changed_sectors = 0;
+    /* The number of sectors that differ */
+    uint64_t first_bit = 0;
+    /* The position in bits of the first FAT entry bit stored in a changed sector */
+
+    fresh_fat_table = (uint8_t *)malloc(s_FAT12Infor.bytes_per_sector * s_FAT12Infor.Sectors_per_FAT);
+
+    /* Check if memory allocation was successful */
+    if (NULL != fresh_fat_table)
+    {
+        /* Read the whole FAT with one range read */
+        number_of_bytes_read_in_FAT = kmc_read_multi_sector((uint64_t)s_FAT12Infor.bytes_per_sector * s_FAT12Infor.Reserved_sector_count, s_FAT12Infor.Sectors_per_FAT, fresh_fat_table);
+
+        /* Check if the correct number of bytes were read */
+        if (number_of_bytes_read_in_FAT == (s_FAT12Infor.Sectors_per_FAT) * (s_FAT12Infor.bytes_per_sector))
+        {
+            /* Compare sector by sector and copy only the sectors that changed */
+            for (sector = 0; sector < s_FAT12Infor.Sectors_per_FAT; sector++)
+            {
+                if (0 != memcmp(&s_fat_table[sector * s_FAT12Infor.bytes_per_sector], &fresh_fat_table[sector * s_FAT12Infor.bytes_per_sector], s_FAT12Infor.bytes_per_sector))
+                {
+                    memcpy(&s_fat_table[sector * s_FAT12Infor.bytes_per_sector], &fresh_fat_table[sector * s_FAT12Infor.bytes_per_sector], s_FAT12Infor.bytes_per_sector);
+                    changed_sectors++;
+
+                    /* Forget the cached chains that use a cluster whose entry is stored, even partly, in this sector */
+                    first_bit = (uint64_t)sector * s_FAT12Infor.bytes_per_sector * 8;
+                    chain_cache_invalidate((uint32_t)(first_bit / s_fat_entry_bits[s_FAT12Infor.Fat_type]),
+                                           (uint32_t)((first_bit + s_FAT12Infor.bytes_per_sector * 8 - 1) / s_fat_entry_bits[s_FAT12Infor.Fat_type]));
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+        }
+        else
+        {
+            /* If the incorrect number of bytes were read, call the error callback with the appropriate error code */
+            error_callback(MULTIPLE_SECTOR_READ_ERROR);
+        }
+
+        free(fresh_fat_table);
+    }
+    else
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+
+    return changed_sectors;
+}
+
+/*
+ *@brief Compute the checksum of a short name, as recorded in its long file name entries.
+ *@param short_name - The 11 bytes of the short name, as stored in the directory entry.
+ *@returns Returns the checksum.
+ */
+static uint8_t lfn_checksum(const uint8_t *short_name)
+{
+    uint8_t sum = 0;
+    /* The checksum being computed */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    for (i = 0; i < FATFS_NAME_KEY_LENGTH; i++)
+    {
+        sum = (uint8_t)(((sum & 1) << 7) + (sum >> 1) + short_name[i]);
+    }
+
+    return sum;
+}
+
+/*
+ *@brief Convert a UTF-16 name to UTF-8.
+ *@param units - The UTF-16 code units of the name.
+ *@param count - The number of code units.
+ *@param out - Receives the UTF-8 name and a terminating '\0', at least 3 bytes per code unit plus one.
+ *@returns Returns the number of bytes written, without the terminating '\0'.
+ */
+static uint32_t utf16_to_utf8(const uint16_t *units, uint32_t count, char *out)
+{
+    uint32_t length = 0;
+    /* The number of bytes written */
+    uint32_t i = 0;
+    /* Loop counter over the code units */
+    uint32_t code_point = 0;
+    /* The character being encoded */
+
+    /* Fast path: most names are ASCII, one byte per code unit */
+    while (i < count && 0x80 > units[i])
+    {
+        out[i] = (char)units[i];
+        i++;
+    }
+    length = i;
+
+    /* General path for the rest of the name */
+    while (i < count)
+    {
+        code_point = units[i];
+        i++;
+
+        /* Combine a surrogate pair, a lone surrogate becomes U+FFFD */
+        if (0xD800 <= code_point && 0xDBFF >= code_point && i < count && 0xDC00 <= units[i] && 0xDFFF >= units[i])
+        {
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (units[i] - 0xDC00);
+            i++;
+        }
+        else if (0xD800 <= code_point && 0xDFFF >= code_point)
+        {
+            code_point = 0xFFFD;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (0x80 > code_point)
+        {
+            out[length++] = (char)code_point;
+        }
+        else if (0x800 > code_point)
+        {
+            out[length++] = (char)(0xC0 | (code_point >> 6));
+            out[length++] = (char)(0x80 | (code_point & 0x3F));
+        }
+        else if (0x10000 > code_point)
+        {
+            out[length++] = (char)(0xE0 | (code_point >> 12));
+            out[length++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            out[length++] = (char)(0x80 | (code_point & 0x3F));
+        }
+        else
+        {
+            out[length++] = (char)(0xF0 | (code_point >> 18));
+            out[length++] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+            out[length++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            out[length++] = (char)(0x80 | (code_point & 0x3F));
+        }
+    }
+    out[length] = '\0';
+
+    return length;
+}
+
+/*
+ *@brief Collect the characters of a VFAT long file name entry.
+ *@param lfn - The long file name being assembled.
+ *@param raw - The 32 bytes of the long file name entry.
+ *@returns No return value. A sequence that is out of order or has a different checksum is discarded.
+ */
+static void lfn_collect(fatfs_lfn_struct_t *lfn, const uint8_t *raw)
+{
+    uint8_t sequence = raw[0] & FATFS_LFN_SEQUENCE_MASK;
+    /* The position of the entry in the sequence, 1 for the entry holding the first characters */
+    uint32_t base = 0;
+    /* The position of the first character of the entry in the name */
+    uint32_t c = 0;
+    /* Loop counter over the characters of the entry */
+
+    /* The entry holding the end of the name comes first and starts a new sequence */
+    if (0 != (raw[0] & FATFS_LFN_LAST_ENTRY_FLAG) && 0 != sequence && FATFS_LFN_MAX_ENTRIES >= sequence)
+    {
+        lfn->Active = 1;
+        lfn->Checksum = raw[13];
+        lfn->Unit_count = sequence * FATFS_LFN_CHARACTERS_PER_ENTRY;
+        lfn->Next_sequence = sequence;
+    }
+    else if (0 != lfn->Active && sequence == lfn->Next_sequence && raw[13] == lfn->Checksum)
+    {
+        /* Do nothing, the entry continues the sequence */
+    }
+    else
+    {
+        lfn->Active = 0;
+    }
+
+    if (0 != lfn->Active && 0 != lfn->Next_sequence)
+    {
+        /* Each entry holds 13 characters: 5 at offset 1, 6 at offset 14 and 2 at offset 28 */
+        base = (sequence - 1) * FATFS_LFN_CHARACTERS_PER_ENTRY;
+        for (c = 0; c < 5; c++)
+        {
+            lfn->Units[base + c] = (uint16_t)(raw[1 + 2 * c] | (raw[2 + 2 * c] << 8));
+        }
+        for (c = 0; c < 6; c++)
+        {
+            lfn->Units[base + 5 + c] = (uint16_t)(raw[14 + 2 * c] | (raw[15 + 2 * c] << 8));
+        }
+        for (c = 0; c < 2; c++)
+        {
+            lfn->Units[base + 11 + c] = (uint16_t)(raw[28 + 2 * c] | (raw[29 + 2 * c] << 8));
+        }
+        lfn->Next_sequence--;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/*
+ *@brief Finish the long file name assembled for a short directory entry.
+ *@param lfn - The long file name being assembled.
+ *@param raw - The 32 bytes of the short directory entry.
+ *@returns Returns the UTF-8 long name, or NULL if the entry has no valid long name.
+ */
+static const char *lfn_finish(fatfs_lfn_struct_t *lfn, const uint8_t *raw)
+{
+    const char *name = NULL;
+    /* The long name returned */
+    uint32_t length = 0;
+    /* The number of characters before the terminating 0x0000 */
+
+    /* The whole sequence must have been seen and must belong to this short name */
+    if (0 != lfn->Active && 0 == lfn->Next_sequence && lfn_checksum(raw) == lfn->Checksum)
+    {
+        while (length < lfn->Unit_count && 0 != lfn->Units[length])
+        {
+            length++;
+        }
+        utf16_to_utf8(lfn->Units, length, lfn->Name);
+        name = lfn->Name;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    lfn->Active = 0;
+
+    return name;
+}
+
+/*
+ *@brief Copy a name into a name arena.
+ *@param arena - The first block of the arena, NULL for an empty arena, updated when a block is added.
+ *@param name - The name to copy.
+ *@returns Returns the copy of the name, or NULL if memory allocation failed.
+ */
+static const char *name_arena_store(fatfs_name_block_struct_t **arena, const char *name)
+{
+    char *copy = NULL;
+    /* The copy of the name */
+    fatfs_name_block_struct_t *block = NULL;
+    /* The block receiving the copy */
+    uint32_t size = (uint32_t)strlen(name) + 1;
+    /* The number of bytes of the name with its terminating '\0' */
+
+    /* Names are appended to the newest block, a new block is added in front when it is full */
+    if (NULL != *arena && FATFS_NAME_BLOCK_SIZE - (*arena)->Used >= size)
+    {
+        block = *arena;
+    }
+    else
+    {
+        block = (fatfs_name_block_struct_t *)malloc(sizeof(fatfs_name_block_struct_t));
+        if (NULL != block)
+        {
+            block->Next = *arena;
+            block->Used = 0;
+            *arena = block;
+        }
+        else
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+    }
+
+    if (NULL != block)
+    {
+        copy = &block->Data[block->Used];
+        memcpy(copy, name, size);
+        block->Used += size;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return copy;
+}
+
+/*
+ *@brief Release every block of a name arena.
+ *@param arena - The first block of the arena, or NULL.
+ *@returns No return value.
+ */
+static void name_arena_release(fatfs_name_block_struct_t *arena)
+{
+    fatfs_name_block_struct_t *next = NULL;
+    /* The block released after the current one */
+
+    while (NULL != arena)
+    {
+        next = arena->Next;
+        free(arena);
+        arena = next;
+    }
+}
+
+/*
+ *@brief Pack an 8.3 name into its name key.
+ *@param name - The 8 characters of the name, padded with spaces.
+ *@param extension - The 3 characters of the extension, padded with spaces.
+ *@param key - Receives the packed name in upper case.
+ *@returns No return value.
+ */
+static void make_name_key(const char *name, const char *extension, fatfs_name_key_struct_t *key)
+{
+    uint32_t i = 0;
+    /* Loop counter */
+
+    key->Name = 0;
+    key->Extension = 0;
+    for (i = 0; i < 8; i++)
+    {
+        key->Name = (key->Name << 8) | (uint8_t)toupper((unsigned char)name[i]);
+    }
+    for (i = 0; i < 3; i++)
+    {
+        key->Extension = (key->Extension << 8) | (uint8_t)toupper((unsigned char)extension[i]);
+    }
+}
+
+/*
+ *@brief Create a new node entry for a directory list.
+ *@param extra_size - The number of bytes reserved after the node for its long name.
+ *@returns Returns a pointer to the newly created node.
+ */
+static DirList *createNodeEntry(uint32_t extra_size)
+{
+    /* Allocate memory for the new node */
+    DirList *newNode = (DirList *)malloc(sizeof(DirList) + extra_size);
+
+    /* Check if memory allocation was successful */
+    if (NULL == newNode)
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+    else
+    {
+        /* If memory allocation was successful, initialize the next pointer of the new node to NULL */
+        newNode->next = NULL;
+    }
+
+    return newNode;
+}
+
+/*
+ *@brief Create a new node for a cluster list.
+ *@param None.
+ *@returns Returns a pointer to the newly created node.
+ */
+static ClusterList *createNodeCluster(void)
+{
+    /* Allocate memory for the new node */
+    ClusterList *newNode = (ClusterList *)malloc(sizeof(ClusterList));
+
+    /* Check if memory allocation was successful */
+    if (NULL == newNode)
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+    else
+    {
+        /* If memory allocation was successful, initialize the next pointer of the new node to NULL */
+        newNode->next = NULL;
+    }
+
+    return newNode;
+}
+
+/*
+ *@brief Parse the boot sector of an exFAT file system.
+ *@param buff - The buffer containing the boot sector data.
+ *@returns Returns 1 if the boot sector describes a valid volume, 0 otherwise.
+ */
+static uint8_t parse_exfat_bootsector(uint8_t *buff)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (success) */
+    uint8_t bytes_per_sector_shift = 0;
+    /* The sector size as a power of two */
+    uint8_t sectors_per_cluster_shift = 0;
+    /* The cluster size in sectors as a power of two */
+    uint64_t volume_length = 0;
+    /* The size of the volume in sectors */
+
+    /* Copy the geometry of the volume from the exFAT boot sector */
+    memcpy(&bytes_per_sector_shift, &buff[108], 1);
+    memcpy(&sectors_per_cluster_shift, &buff[109], 1);
+    memcpy(&s_FAT12Infor.Number_of_FATs, &buff[110], 1);
+    memcpy(&volume_length, &buff[72], 8);
+    memcpy(&s_FAT12Infor.Reserved_sector_count, &buff[80], 4);
+    memcpy(&s_FAT12Infor.Sectors_per_FAT, &buff[84], 4);
+    memcpy(&s_FAT12Infor.Cluster_heap_offset, &buff[88], 4);
+    memcpy(&s_FAT12Infor.Cluster_count, &buff[92], 4);
+    memcpy(&s_FAT12Infor.Root_cluster, &buff[96], 4);
+
+    /* Sectors are 512 to 4096 bytes, clusters at most 32 MB, and the FAT must cover every cluster */
+    if (9 > bytes_per_sector_shift || 12 < bytes_per_sector_shift || 15 < sectors_per_cluster_shift ||
+        FATFS_EXFAT_MAX_CLUSTER_SHIFT < bytes_per_sector_shift + sectors_per_cluster_shift || 0 == s_FAT12Infor.Number_of_FATs ||
+        ((uint64_t)s_FAT12Infor.Sectors_per_FAT << bytes_per_sector_shift) < ((uint64_t)s_FAT12Infor.Cluster_count + 2) * 4 ||
+        2 > s_FAT12Infor.Root_cluster || s_FAT12Infor.Cluster_count + 2 <= s_FAT12Infor.Root_cluster)
+    {
+        result = 0;
+    }
+    else
+    {
+        s_FAT12Infor.bytes_per_sector = (uint16_t)(1U << bytes_per_sector_shift);
+        s_FAT12Infor.sectors_per_cluster = (uint16_t)(1U << sectors_per_cluster_shift);
+        s_FAT12Infor.Total_sector_count = (0xFFFFFFFFU < volume_length) ? 0xFFFFFFFFU : (uint32_t)volume_length;
+        s_FAT12Infor.Fat_type = FATFS_TYPE_EXFAT;
+    }
+
+    return result;
+}
+
+/*
+ *@brief Parse the boot sector of a FAT12, FAT16 or FAT32 file system.
+ *@param buff - The buffer containing the boot sector data.
+ *@returns Returns 1 if the boot sector describes a valid volume, 0 otherwise.
+ */
+static uint8_t parse_bootsector(uint8_t *buff)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (success) */
+    uint16_t sectors_16 = 0;
+    /* Variable to store a 16-bit sector count field */
+    uint32_t root_directory_sectors = 0;
+    /* The number of sectors in the fixed root directory region */
+    uint32_t data_sectors = 0;
+    /* The number of sectors in the data area */
+    uint32_t metadata_sectors = 0;
+    /* The number of sectors before the data area */
+    uint32_t fat_entries = 0;
+    /* The number of entries that fit in one FAT */
+
+    /* exFAT volumes are recognized by name, their BPB area is zero */
+    memset(&s_FAT12Infor, 0, sizeof(s_FAT12Infor));
+    if (0 == memcmp(&buff[3], "EXFAT   ", 8))
+    {
+        result = parse_exfat_bootsector(buff);
+    }
+    else
+    {
+        /* Copy the bytes per sector,sectors per cluster,  number of FATs, maximum number of root directory entries,
+           total sector count, sectors per FAT value from the buffer to the FAT12 info structure */
+        memcpy(&s_FAT12Infor.bytes_per_sector, &buff[11], 2);
+        memcpy(&s_FAT12Infor.sectors_per_cluster, &buff[13], 1);
+        memcpy(&s_FAT12Infor.Reserved_sector_count, &buff[14], 2);
+        memcpy(&s_FAT12Infor.Number_of_FATs, &buff[16], 1);
+        memcpy(&s_FAT12Infor.Maximum_number_of_root_directory_entries, &buff[17], 2);
+
+        /* The 16-bit total sector count is 0 when the volume needs the 32-bit field */
+        memcpy(&sectors_16, &buff[19], 2);
+        if (0 != sectors_16)
+        {
+            s_FAT12Infor.Total_sector_count = sectors_16;
+        }
+        else
+        {
+            memcpy(&s_FAT12Infor.Total_sector_count, &buff[32], 4);
+        }
+
+        /* The 16-bit sectors per FAT is 0 on FAT32, which stores a 32-bit value in the extended BPB */
+        memcpy(&sectors_16, &buff[22], 2);
+        if (0 != sectors_16)
+        {
+            s_FAT12Infor.Sectors_per_FAT = sectors_16;
+        }
+        else
+        {
+            memcpy(&s_FAT12Infor.Sectors_per_FAT, &buff[36], 4);
+            memcpy(&s_FAT12Infor.Root_cluster, &buff[44], 4);
+        }
+
+        /* Check the fields used as divisors and multipliers below */
+        if (0 == s_FAT12Infor.bytes_per_sector || 0 == s_FAT12Infor.sectors_per_cluster || 0 == s_FAT12Infor.Number_of_FATs ||
+            0 == s_FAT12Infor.Sectors_per_FAT)
+        {
+            result = 0;
+        }
+        else
+        {
+            /* Count the clusters in the data area */
+            root_directory_sectors = ((s_FAT12Infor.Maximum_number_of_root_directory_entries * FATFS_DIRECTORY_ENTRY_SIZE) + (s_FAT12Infor.bytes_per_sector - 1)) / s_FAT12Infor.bytes_per_sector;
+            metadata_sectors = s_FAT12Infor.Reserved_sector_count + (s_FAT12Infor.Number_of_FATs * s_FAT12Infor.Sectors_per_FAT) + root_directory_sectors;
+
+            if (metadata_sectors >= s_FAT12Infor.Total_sector_count)
+            {
+                result = 0;
+            }
+            else
+            {
+                data_sectors = s_FAT12Infor.Total_sector_count - metadata_sectors;
+                s_FAT12Infor.Cluster_count = data_sectors / s_FAT12Infor.sectors_per_cluster;
+
+                /* The FAT type is defined by the cluster count alone */
+                if (FATFS_FAT12_MAX_CLUSTERS > s_FAT12Infor.Cluster_count)
+                {
+                    s_FAT12Infor.Fat_type = FATFS_TYPE_FAT12;
+                }
+                else if (FATFS_FAT16_MAX_CLUSTERS > s_FAT12Infor.Cluster_count)
+                {
+                    s_FAT12Infor.Fat_type = FATFS_TYPE_FAT16;
+                }
+                else
+                {
+                    s_FAT12Infor.Fat_type = FATFS_TYPE_FAT32;
+                }
+
+                /* Never follow a cluster whose entry lies beyond the end of the FAT */
+                fat_entries = (uint32_t)(((uint64_t)s_FAT12Infor.Sectors_per_FAT * s_FAT12Infor.bytes_per_sector * 8) / s_fat_entry_bits[s_FAT12Infor.Fat_type]);
+                if (s_FAT12Infor.Cluster_count + 2 > fat_entries)
+                {
+                    s_FAT12Infor.Cluster_count = (2 < fat_entries) ? (fat_entries - 2) : 0;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ *@brief Check whether a run of clusters is marked allocated in the exFAT allocation bitmap.
+ *@param first_cluster - The first cluster of the run.
+ *@param cluster_count - The number of clusters in the run.
+ *@returns Returns 1 if every cluster of the run is allocated, 0 otherwise.
+ */
+static uint8_t exfat_is_run_allocated(uint32_t first_cluster, uint32_t cluster_count)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (allocated) */
+    uint32_t bit = 0;
+    /* Index of the bitmap bit of the current cluster */
+
+    /* Check that the run lies inside the cluster heap */
+    if (2 > first_cluster || (uint64_t)first_cluster + cluster_count > (uint64_t)s_FAT12Infor.Cluster_count + 2 ||
+        ((uint64_t)first_cluster - 2 + cluster_count) > (uint64_t)s_allocation_bitmap_size * 8)
+    {
+        result = 0;
+    }
+    else
+    {
+        /* Check the bit of every cluster of the run, the first bit describes cluster 2 */
+        for (bit = first_cluster - 2; bit < first_cluster - 2 + cluster_count && 1 == result; bit++)
+        {
+            if (0 == (s_allocation_bitmap[bit / 8] & (1U << (bit % 8))))
+            {
+                result = 0;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+    }
+
+    return result;
+}
+
+/*
+ *@brief Find a stream in the exFAT stream table.
+ *@param first_cluster - The first cluster of the stream.
+ *@returns Returns a pointer to the stream, or NULL if it has not been seen.
+ */
+static fatfs_exfat_stream_struct_t *exfat_find_stream(uint32_t first_cluster)
+{
+    fatfs_exfat_stream_struct_t *stream = NULL;
+    /* The stream found */
+    uint32_t slot = 0;
+    /* The slot being probed */
+
+    /* Check if the table has been created */
+    if (0 != s_exfat_stream_capacity)
+    {
+        /* Probe linearly from the home slot until the stream or an empty slot is found */
+        slot = (first_cluster * 2654435761U) & (s_exfat_stream_capacity - 1);
+        while (0 != s_exfat_streams[slot].First_cluster && NULL == stream)
+        {
+            if (first_cluster == s_exfat_streams[slot].First_cluster)
+            {
+                stream = &s_exfat_streams[slot];
+            }
+            else
+            {
+                slot = (slot + 1) & (s_exfat_stream_capacity - 1);
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return stream;
+}
+
+/*
+ *@brief Remember the layout and parent of an exFAT stream.
+ *@param first_cluster - The first cluster of the stream.
+ *@param cluster_count - The number of clusters of a NoFatChain stream, 0 if the stream uses the FAT.
+ *@param parent_cluster - The first cluster of the directory containing the stream, 0 for the root directory.
+ *@returns No return value.
+ */
+static void exfat_register_stream(uint32_t first_cluster, uint32_t cluster_count, uint32_t parent_cluster)
+{
+    fatfs_exfat_stream_struct_t *stream = NULL;
+    /* The slot of the stream */
+    fatfs_exfat_stream_struct_t *old_streams = s_exfat_streams;
+    /* The table before growing */
+    uint32_t old_capacity = s_exfat_stream_capacity;
+    /* The number of slots before growing */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Keep the table at most half full so that probe sequences stay short */
+    if ((s_exfat_stream_count + 1) * 2 > s_exfat_stream_capacity)
+    {
+        s_exfat_stream_capacity = (0 == old_capacity) ? 64 : old_capacity * 2;
+        s_exfat_streams = (fatfs_exfat_stream_struct_t *)calloc(s_exfat_stream_capacity, sizeof(fatfs_exfat_stream_struct_t));
+
+        /* Check if memory allocation was successful */
+        if (NULL == s_exfat_streams)
+        {
+            /* Keep the old table, the stream will be read through the FAT */
+            s_exfat_streams = old_streams;
+            s_exfat_stream_capacity = old_capacity;
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+        else
+        {
+            /* Move every stream into the new table */
+            s_exfat_stream_count = 0;
+            for (i = 0; i < old_capacity; i++)
+            {
+                if (0 != old_streams[i].First_cluster)
+                {
+                    exfat_register_stream(old_streams[i].First_cluster, old_streams[i].Cluster_count, old_streams[i].Parent_cluster);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            free(old_streams);
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Insert the stream, or update it if it was seen before */
+    if ((s_exfat_stream_count + 1) * 2 <= s_exfat_stream_capacity)
+    {
+        stream = exfat_find_stream(first_cluster);
+        if (NULL == stream)
+        {
+            i = (first_cluster * 2654435761U) & (s_exfat_stream_capacity - 1);
+            while (0 != s_exfat_streams[i].First_cluster)
+            {
+                i = (i + 1) & (s_exfat_stream_capacity - 1);
+            }
+            stream = &s_exfat_streams[i];
+            s_exfat_stream_count++;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        stream->First_cluster = first_cluster;
+        stream->Cluster_count = cluster_count;
+        stream->Parent_cluster = parent_cluster;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/*
+ *@brief Read a whole exFAT stream (directory or allocation bitmap) into one buffer.
+ *@param first_cluster - The first cluster of the stream.
+ *@param length - Receives the number of bytes read.
+ *@returns Returns an allocated buffer holding the stream, or NULL on failure or if the stream is larger than FATFS_STREAM_MAX_SIZE.
+ *         The caller frees it.
+ */
+static uint8_t *exfat_read_stream(uint32_t first_cluster, uint32_t *length)
+{
+    uint8_t *buff = NULL;
+    /* Buffer to store the data read from the file system */
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    fatfs_exfat_stream_struct_t *stream = exfat_find_stream(first_cluster);
+    /* The layout of the stream, if it has been seen in a directory listing */
+    fatfs_extent_struct_t *extents = NULL;
+    /* The extents of a stream that uses the FAT */
+    uint32_t extent_count = 0;
+    /* The number of extents */
+    uint64_t chain_length = 0;
+    /* The number of clusters in the chain */
+    uint64_t number_of_bytes_read = 0;
+    /* Variable to store the number of bytes read */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    *length = 0;
+
+    /* A NoFatChain stream whose clusters are allocated is read with a single range read, without touching the FAT */
+    if (NULL != stream && 0 != stream->Cluster_count && 0 != exfat_is_run_allocated(first_cluster, stream->Cluster_count))
+    {
+        /* A stream too large for one buffer is refused rather than truncated */
+        if (FATFS_STREAM_MAX_SIZE >= (uint64_t)stream->Cluster_count * Cluster_size)
+        {
+            buff = (uint8_t *)malloc((size_t)stream->Cluster_count * Cluster_size);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Check if memory allocation was successful */
+        if (NULL != buff)
+        {
+            number_of_bytes_read = kmc_read_multi_sector(get_cluster_offset(first_cluster), stream->Cluster_count * s_FAT12Infor.sectors_per_cluster, buff);
+            *length = (uint32_t)number_of_bytes_read;
+        }
+        else
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+    }
+    else
+    {
+        /* Otherwise follow the FAT and read one extent at a time */
+        extents = get_cluster_extents(first_cluster, &extent_count);
+
+        for (i = 0; i < extent_count; i++)
+        {
+            chain_length += extents[i].Cluster_count;
+        }
+
+        /* A stream too large for one buffer is refused rather than truncated */
+        if (0 != chain_length && FATFS_STREAM_MAX_SIZE >= chain_length * Cluster_size)
+        {
+            buff = (uint8_t *)malloc((size_t)(chain_length * Cluster_size));
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Check if memory allocation was successful */
+        if (NULL != buff)
+        {
+            for (i = 0; i < extent_count; i++)
+            {
+                number_of_bytes_read = kmc_read_multi_sector(get_cluster_offset(extents[i].First_cluster), extents[i].Cluster_count * s_FAT12Infor.sectors_per_cluster, &buff[*length]);
+
+                /* Stop at the first extent that cannot be read */
+                if (number_of_bytes_read != (uint64_t)extents[i].Cluster_count * Cluster_size)
+                {
+                    i = extent_count;
+                }
+                else
+                {
+                    *length += (uint32_t)number_of_bytes_read;
+                }
+            }
+        }
+        else if (0 != chain_length)
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Free the extents */
+        free(extents);
+    }
+
+    return buff;
+}
+
+/*
+ *@brief Load the exFAT allocation bitmap described in the root directory.
+ *@param None.
+ *@returns Returns 1 if the bitmap was loaded, 0 otherwise.
+ */
+static uint8_t exfat_load_allocation_bitmap(void)
+{
+    uint8_t *buff = NULL;
+    /* Buffer holding the root directory */
+    uint32_t length = 0;
+    /* The number of bytes in the root directory */
+    uint32_t i = 0;
+    /* Loop counter */
+    uint32_t first_cluster = 0;
+    /* The first cluster of the bitmap */
+    uint64_t data_length = 0;
+    /* The size of the bitmap in bytes */
+
+    buff = exfat_read_stream(s_FAT12Infor.Root_cluster, &length);
+
+    /* Find the first allocation bitmap entry of the root directory */
+    for (i = 0; i < length && FATFS_EXFAT_ENTRY_END_OF_DIRECTORY != buff[i] && NULL == s_allocation_bitmap; i += FATFS_DIRECTORY_ENTRY_SIZE)
+    {
+        if (FATFS_EXFAT_ENTRY_ALLOCATION_BITMAP == buff[i])
+        {
+            memcpy(&first_cluster, &buff[i + 20], 4);
+            memcpy(&data_length, &buff[i + 24], 8);
+
+            /* The bitmap needs one bit per cluster */
+            if (data_length * 8 >= s_FAT12Infor.Cluster_count)
+            {
+                s_allocation_bitmap = exfat_read_stream(first_cluster, &s_allocation_bitmap_size);
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    free(buff);
+
+    return (NULL != s_allocation_bitmap && (uint64_t)s_allocation_bitmap_size * 8 >= s_FAT12Infor.Cluster_count) ? 1 : 0;
+}
+
+/*
+ *@brief Compute the checksum of an exFAT directory entry set.
+ *@param entries - The first entry (the file entry) of the set.
+ *@param entry_count - The number of entries in the set, including the file entry.
+ *@returns Returns the 16-bit set checksum.
+ */
+static uint16_t exfat_entry_set_checksum(const uint8_t *entries, uint32_t entry_count)
+{
+    uint16_t checksum = 0;
+    /* The running checksum */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Every byte except the checksum field itself is rotated into the checksum */
+    for (i = 0; i < entry_count * FATFS_DIRECTORY_ENTRY_SIZE; i++)
+    {
+        if (2 != i && 3 != i)
+        {
+            checksum = (uint16_t)(((checksum & 1) ? 0x8000 : 0) + (checksum >> 1) + entries[i]);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    return checksum;
+}
+
+/*
+ *@brief Fill the 8.3 name fields of the directory entry from an exFAT file name.
+ *@param name - The file name, converted to ASCII.
+ *@param name_length - The number of characters in the name.
+ *@returns No return value.
+ */
+static void exfat_make_short_name(const char *name, uint32_t name_length)
+{
+    uint32_t dot = name_length;
+    /* Position of the last dot, name_length if there is none */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Find the dot that separates the extension, a leading dot is part of the name */
+    for (i = 1; i < name_length; i++)
+    {
+        if ('.' == name[i])
+        {
+            dot = i;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    /* Space-pad the fields like an 8.3 directory entry; a leading dot is reserved for the "." and ".." entries */
+    memset(s_dirList.File_name, ' ', 8);
+    memset(s_dirList.Extension, ' ', 3);
+    for (i = 0; i < dot && i < 8; i++)
+    {
+        s_dirList.File_name[i] = ('.' == name[i] && 0 == i) ? '_' : name[i];
+    }
+    for (i = 0; dot + 1 + i < name_length && i < 3; i++)
+    {
+        s_dirList.Extension[i] = name[dot + 1 + i];
+    }
+    s_dirList.File_name[8] = '\0';
+    s_dirList.Extension[3] = '\0';
+    s_dirList.Extension[4] = '\0';
+    make_name_key(s_dirList.File_name, s_dirList.Extension, &s_dirList.Name_key);
+}
+
+/*
+ *@brief Append a copy of an entry to a directory array, growing the array when it is full.
+ *@param array - The directory array, which may be moved by the reallocation.
+ *@param entry - The entry to append.
+ *@returns No return value.
+ */
+static void append_directory_entry(DirArray **array, const fatfs_directory_entry_list_struct_t *entry)
+{
+    DirArray *grown = NULL;
+    /* The directory array after it has grown */
+
+    /* Double the capacity when the array is full */
+    if ((*array)->count == (*array)->capacity)
+    {
+        grown = (DirArray *)realloc(*array, sizeof(DirArray) + 2 * (*array)->capacity * sizeof(fatfs_directory_entry_list_struct_t));
+        if (NULL != grown)
+        {
+            grown->capacity *= 2;
+            *array = grown;
+        }
+        else
+        {
+            /* If memory allocation failed, call the error callback with the appropriate error code */
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Check if there is room for the entry */
+    if ((*array)->count < (*array)->capacity)
+    {
+        /* Copy the entry to the end of the array */
+        memcpy(&(*array)->entries[(*array)->count], entry, sizeof(fatfs_directory_entry_list_struct_t));
+        /* The long name lives in the buffer of the decoder, keep a copy next to the array */
+        if (NULL != entry->Long_name)
+        {
+            (*array)->entries[(*array)->count].Long_name = name_arena_store(&(*array)->names, entry->Long_name);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        (*array)->count++;
+    }
+    else
+    {
+        /* Do nothing, the error callback has already been called */
+    }
+}
+
+/*
+ *@brief Decode the exFAT entry set at a position of a directory buffer into s_dirList.
+ *@param buff - The buffer holding the raw directory entries.
+ *@param length - The number of bytes in the buffer.
+ *@param position - The offset of the entry to decode, advanced past the entries consumed.
+ *@param parent_cluster - The first cluster of the directory, 0 for the root directory, recorded as the parent of the stream.
+ *@param lfn - Receives the full name of the entry in UTF-8.
+ *@returns Returns FATFS_DECODE_ENTRY if s_dirList holds an entry, FATFS_DECODE_SKIP if the entry is not listed, FATFS_DECODE_END at the end of the directory.
+ */
+static uint8_t exfat_decode_entry_set(const uint8_t *buff, uint32_t length, uint32_t *position, uint32_t parent_cluster, fatfs_lfn_struct_t *lfn)
+{
+    uint8_t result = FATFS_DECODE_SKIP;
+    /* Default result is an entry that is not listed */
+    uint32_t i = *position;
+    /* Offset of the file entry */
+    uint32_t k = 0;
+    /* Offset of the current file name entry */
+    uint32_t c = 0;
+    /* Loop counter over the characters of a file name entry */
+    uint32_t secondary_count = 0;
+    /* The number of secondary entries of the current entry set */
+    uint32_t stream = 0;
+    /* Offset of the stream extension entry of the current entry set */
+    uint16_t stored_checksum = 0;
+    /* The checksum recorded in the file entry */
+    uint16_t attributes = 0;
+    /* The exFAT file attributes */
+    uint8_t name_length = 0;
+    /* The number of characters in the name */
+    char name[FATFS_EXFAT_MAX_NAME_LENGTH + 1];
+    /* The file name converted to ASCII */
+    uint32_t name_position = 0;
+    /* The number of characters of the name collected so far */
+    uint64_t data_length = 0;
+    /* The size of the stream in bytes */
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+
+    /* By default a single entry is consumed */
+    *position = i + FATFS_DIRECTORY_ENTRY_SIZE;
+
+    if (FATFS_EXFAT_ENTRY_END_OF_DIRECTORY == buff[i])
+    {
+        result = FATFS_DECODE_END;
+    }
+    /* Only file entry sets are listed, the bitmap, up-case table, volume label and deleted entries are skipped */
+    else if (FATFS_EXFAT_ENTRY_FILE == buff[i])
+    {
+        secondary_count = buff[i + 1];
+        stream = i + FATFS_DIRECTORY_ENTRY_SIZE;
+        memcpy(&stored_checksum, &buff[i + 2], 2);
+
+        /* A valid set has a stream extension, at least one name entry, and a matching checksum */
+        if (2 <= secondary_count && length >= i + (secondary_count + 1) * FATFS_DIRECTORY_ENTRY_SIZE &&
+            FATFS_EXFAT_ENTRY_STREAM_EXTENSION == buff[stream] &&
+            stored_checksum == exfat_entry_set_checksum(&buff[i], secondary_count + 1))
+        {
+            /* Copy the attributes, creation and last write timestamps, first cluster and size */
+            memset(&s_dirList, 0, sizeof(s_dirList));
+            memcpy(&attributes, &buff[i + 4], 2);
+            s_dirList.Attributes = (uint8_t)attributes;
+            memcpy(&s_dirList.Creation_Time, &buff[i + 8], 2);
+            memcpy(&s_dirList.Creation_Date, &buff[i + 10], 2);
+            memcpy(&s_dirList.Last_Write_Time, &buff[i + 12], 2);
+            memcpy(&s_dirList.Last_Write_Date, &buff[i + 14], 2);
+            memcpy(&name_length, &buff[stream + 3], 1);
+            memcpy(&s_dirList.First_Logical_Cluster, &buff[stream + 20], 4);
+            memcpy(&data_length, &buff[stream + 24], 8);
+            s_dirList.File_Size_in_bytes = data_length;
+
+            /* Collect the name from the file name entries that follow the stream extension */
+            for (k = stream + FATFS_DIRECTORY_ENTRY_SIZE; k < i + (secondary_count + 1) * FATFS_DIRECTORY_ENTRY_SIZE; k += FATFS_DIRECTORY_ENTRY_SIZE)
+            {
+                if (FATFS_EXFAT_ENTRY_FILE_NAME == buff[k])
+                {
+                    for (c = 0; c < FATFS_EXFAT_NAME_CHARACTERS_PER_ENTRY && name_position < name_length; c++)
+                    {
+                        /* Characters outside printable ASCII are shown as '_' in the short name */
+                        name[name_position] = (0 == buff[k + 3 + 2 * c] && 0x20 <= buff[k + 2 + 2 * c] && 0x7F > buff[k + 2 + 2 * c]) ? (char)buff[k + 2 + 2 * c] : '_';
+                        lfn->Units[name_position] = (uint16_t)(buff[k + 2 + 2 * c] | (buff[k + 3 + 2 * c] << 8));
+                        name_position++;
+                    }
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            name[name_position] = '\0';
+            exfat_make_short_name(name, name_position);
+
+            /* The full name is the long name of the entry */
+            utf16_to_utf8(lfn->Units, name_position, lfn->Name);
+            s_dirList.Long_name = lfn->Name;
+
+            /* Remember how the stream is stored and where it is listed */
+            if (0 != s_dirList.First_Logical_Cluster)
+            {
+                exfat_register_stream(s_dirList.First_Logical_Cluster,
+                                      (0 != (buff[stream + 1] & FATFS_EXFAT_FLAG_NO_FAT_CHAIN)) ? (uint32_t)((data_length + Cluster_size - 1) / Cluster_size) : 0,
+                                      parent_cluster);
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            /* Continue after the last secondary entry of the set */
+            *position = i + (secondary_count + 1) * FATFS_DIRECTORY_ENTRY_SIZE;
+            result = FATFS_DECODE_ENTRY;
+        }
+        else
+        {
+            /* Do nothing, a damaged set is skipped entry by entry */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Retrieve the extents of a file on an exFAT file system.
+ *@param first_cluster - The first cluster of the file.
+ *@param extent_count - Receives the number of extents.
+ *@returns Returns an allocated array of extents, or NULL if the file is empty. The caller frees it.
+ */
+static fatfs_extent_struct_t *exfat_get_file_extents(uint32_t first_cluster, uint32_t *extent_count)
+{
+    fatfs_extent_struct_t *extents = NULL;
+    /* The extents of the file */
+    fatfs_exfat_stream_struct_t *stream = exfat_find_stream(first_cluster);
+    /* The layout of the file, if it has been seen in a directory listing */
+
+    *extent_count = 0;
+
+    /* A NoFatChain file whose clusters are allocated is one extent, found without touching the FAT */
+    if (NULL != stream && 0 != stream->Cluster_count && 0 != exfat_is_run_allocated(first_cluster, stream->Cluster_count))
+    {
+        extents = (fatfs_extent_struct_t *)malloc(sizeof(fatfs_extent_struct_t));
+
+        /* Check if memory allocation was successful */
+        if (NULL != extents)
+        {
+            extents[0].First_cluster = first_cluster;
+            extents[0].Cluster_count = stream->Cluster_count;
+            *extent_count = 1;
+        }
+        else
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+    }
+    else
+    {
+        /* Otherwise follow the FAT */
+        extents = get_cluster_extents(first_cluster, extent_count);
+    }
+
+    return extents;
+}
+
+/*
+ *@brief Mount the volume of the opened image.
+ *@param None.
+ *@returns Returns the size of the cluster, 0 on failure.
+ */
+static uint32_t mount_volume(void)
+{
+    uint32_t Cluster_size = 0;
+    /* Variable to store the size of the cluster */
+    uint32_t number_of_bytes_read = 0;
+    /* Variable to store the number of bytes read */
+    uint8_t *buff;
+    /* Buffer to store the data read from the file system */
+
+    /* Allocate memory for the buffer */
+    buff = (uint8_t *)calloc(KMC_DEFAULT_SECTOR_SIZE, sizeof(uint8_t));
+
+    /* Check if memory allocation was successful */
+    if (NULL != buff)
+    {
+        /* Read the sector at index 0 into the buffer, with the sector size of the boot sector */
+        kmc_update_sector_size(KMC_DEFAULT_SECTOR_SIZE);
+        number_of_bytes_read = kmc_read_sector(0, buff);
+
+        /* Check if the correct number of bytes were read */
+        if (KMC_DEFAULT_SECTOR_SIZE != number_of_bytes_read)
+        {
+            /* If reading the boot sector failed, call the error callback with the appropriate error code */
+            error_callback(BOOT_SECTOR_READ_ERROR);
+        }
+        /* Parse the boot sector data from the buffer */
+        else if (0 == parse_bootsector(buff))
+        {
+            /* If the boot sector does not describe a valid volume, call the error callback with the appropriate error code */
+            error_callback(INVALID_BOOT_SECTOR);
+        }
+        else
+        {
+            /* Keep the boot sector and the image stamp to detect changes later */
+            memcpy(s_boot_sector, buff, KMC_DEFAULT_SECTOR_SIZE);
+            kmc_get_image_stamp(&s_image_stamp);
+
+            /* Update the sector size for the KMC */
+            if (0 != kmc_update_sector_size(s_FAT12Infor.bytes_per_sector))
+            {
+                /* Retrieve the FAT table, together with the tree index from the mount snapshot when it still describes the image */
+                if (0 != (s_mount_options & FATFS_MOUNT_SNAPSHOT))
+                {
+                    snapshot_load();
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+
+                if (NULL == s_fat_table)
+                {
+                    get_fat_table();
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+
+                /* Calculate the size of the cluster */
+                Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+                /* Calculate the number of clusters in the root directory, which is 0 on FAT32 and exFAT */
+                num_cluster_in_root_directory = ((s_FAT12Infor.Maximum_number_of_root_directory_entries * FATFS_DIRECTORY_ENTRY_SIZE) + (s_FAT12Infor.bytes_per_sector - 1)) / s_FAT12Infor.bytes_per_sector;
+
+                /* Calculate the physical start of the root directory in clusters */
+                cluster_started_in_physical_of_rootdirectory = (s_FAT12Infor.Number_of_FATs * s_FAT12Infor.Sectors_per_FAT) + s_FAT12Infor.Reserved_sector_count;
+
+                /* Calculate the physical start of the data area in clusters, recorded in the boot sector on exFAT */
+                if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+                {
+                    Cluster_starts_in_physical_of_the_data_area = s_FAT12Infor.Cluster_heap_offset;
+
+                    /* Load the allocation bitmap used for the contiguous file fast path */
+                    if (0 == exfat_load_allocation_bitmap())
+                    {
+                        error_callback(ERROR_READING_ROOT_DIRECTORY);
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+                }
+                else
+                {
+                    Cluster_starts_in_physical_of_the_data_area = cluster_started_in_physical_of_rootdirectory + num_cluster_in_root_directory;
+                }
+            }
+            else
+            {
+                /* If updating the sector size failed, call the error callback with the appropriate error code */
+                error_callback(ERROR_UPDATING_SECTOR_SIZE);
+            }
+        }
+
+        /* Free the memory allocated for the buffer */
+        free(buff);
+    }
+    else
+    {
+        /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+
+    return Cluster_size;
+}
+
+/*
+ *@brief Release everything loaded by mount_volume.
+ *@param None.
+ *@returns No return value.
+ */
+static void unmount_volume(void)
+{
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Forget every cached cluster chain and path component */
+    chain_cache_flush();
+    memset(s_dentry_cache, 0, sizeof(s_dentry_cache));
+    for (i = 0; i < FATFS_DIR_CACHE_SLOTS; i++)
+    {
+        deallocate_Dir_Array(s_dir_cache[i].Listing);
+        free(s_dir_cache[i].Index);
+    }
+    memset(s_dir_cache, 0, sizeof(s_dir_cache));
+    tree_index_release();
+    free(s_du_memo);
+    s_du_memo = NULL;
+    s_du_memo_capacity = 0;
+    s_du_memo_count = 0;
+    for (i = 0; i < FATFS_FINGERPRINT_SLOTS; i++)
+    {
+        deallocate_Dir_Array(s_dir_fingerprints[i].Listing);
+        free(s_dir_fingerprints[i].Clusters);
+    }
+    memset(s_dir_fingerprints, 0, sizeof(s_dir_fingerprints));
+    /* Deallocate the FAT table */
+    free(s_fat_table);
+    s_fat_table = NULL;
+    /* Deallocate the exFAT allocation bitmap and stream table */
+    free(s_allocation_bitmap);
+    s_allocation_bitmap = NULL;
+    s_allocation_bitmap_size = 0;
+    free(s_exfat_streams);
+    s_exfat_streams = NULL;
+    s_exfat_stream_capacity = 0;
+    s_exfat_stream_count = 0;
+}
+
+/*
+ *@brief Initialize the FAT file system.
+ *@param path - The path to the file system.
+ *@param callback - The callback function for error handling.
+ *@returns Returns the size of the cluster.
+ */
+uint32_t fatfs_init(const char *path, ErrorCallback callback)
+{
+    return fatfs_init_with_options(path, callback, 0);
+}
+
+/*
+ *@brief Initialize the FAT file system with mount options.
+ *@param path - The path to the image.
+ *@param callback - The error callback function.
+ *@param options - A combination of FATFS_MOUNT_ flags.
+ *@returns Returns the size of the cluster.
+ */
+uint32_t fatfs_init_with_options(const char *path, ErrorCallback callback, uint32_t options)
+{
+    uint32_t Cluster_size = 0;
+    /* Variable to store the size of the cluster */
+
+    /* Set the error callback function */
+    error_callback = callback;
+    /* The mount snapshot holds the tree index, so it implies the tree index */
+    if (0 != (options & FATFS_MOUNT_SNAPSHOT))
+    {
+        options |= FATFS_MOUNT_TREE_INDEX;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    s_mount_options = options;
+    /* Initialize the KMC with the given path */
+    if (0 != kmc_init(path))
+    {
+        /* Read the boot sector and the FAT, and load the tree index from the mount snapshot when requested */
+        Cluster_size = mount_volume();
+
+        /* Read every directory of the volume into the tree index if requested and not loaded from the snapshot */
+        if (0 != Cluster_size && 0 != (s_mount_options & FATFS_MOUNT_TREE_INDEX) && NULL == s_tree_nodes)
+        {
+            if (0 != tree_index_build())
+            {
+                snapshot_save();
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* If initializing the KMC failed, call the error callback with the appropriate error code */
+        error_callback(ERROR_OPENING_FILE);
+    }
+
+    return Cluster_size;
+}
+
+/*
+ *@brief Classify a group of directory entries, building one mask per kind of entry.
+ *@param buff - The first entry of the group.
+ *@param count - The number of entries in the group, at most FATFS_SCAN_GROUP_ENTRIES.
+ *@param masks - Receives the masks of the group.
+ *@returns No return value.
+ */
+static void scan_directory_entries(const uint8_t *buff, uint32_t count, fatfs_scan_masks_struct_t *masks)
+{
+    uint8_t first[FATFS_SCAN_GROUP_ENTRIES] = {0};
+    /* The first byte of each entry */
+    uint8_t attributes[FATFS_SCAN_GROUP_ENTRIES] = {0};
+    /* The attribute byte of each entry */
+    uint32_t valid = (FATFS_SCAN_GROUP_ENTRIES == count) ? 0xFFFFU : ((1U << count) - 1U);
+    /* The bits of the entries present in the group */
+    uint32_t end = 0;
+    /* Entries whose first byte is 0x00 */
+    uint32_t deleted = 0;
+    /* Entries whose first byte is the deleted marker */
+    uint32_t lfn = 0;
+    /* Entries whose attribute byte is the long file name attribute */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* The two bytes that classify an entry are gathered so that the whole group is compared at once */
+    for (i = 0; i < count; i++)
+    {
+        first[i] = buff[i * FATFS_DIRECTORY_ENTRY_SIZE];
+        attributes[i] = buff[i * FATFS_DIRECTORY_ENTRY_SIZE + 11];
+    }
+
+#if defined(__SSE2__)
+    end = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)first), _mm_setzero_si128()));
+    deleted = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)first), _mm_set1_epi8((char)FATFS_DELETED_ENTRY)));
+    lfn = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)attributes), _mm_set1_epi8((char)FATFS_LFN_ATTRIBUTE)));
+#else
+    for (i = 0; i < FATFS_SCAN_GROUP_ENTRIES; i++)
+    {
+        end |= (uint32_t)(0 == first[i]) << i;
+        deleted |= (uint32_t)(FATFS_DELETED_ENTRY == first[i]) << i;
+        lfn |= (uint32_t)(FATFS_LFN_ATTRIBUTE == attributes[i]) << i;
+    }
+#endif
+
+    /* A free entry is never a long file name entry, whatever its attribute byte */
+    masks->End = (uint16_t)(end & valid);
+    masks->Lfn = (uint16_t)(lfn & ~end & valid);
+    masks->Deleted = (uint16_t)(deleted & valid);
+    masks->Short = (uint16_t)(~lfn & ~end & valid);
+}
+
+/*
+ *@brief Decode a FAT short directory entry into s_dirList.
+ *@param raw - The 32 bytes of the entry.
+ *@param excluded_cluster - An entry pointing to this cluster (the directory itself) is skipped, 0 to keep every entry.
+ *@param lfn - The long file name assembled from the entries that precede the short entry.
+ *@returns Returns FATFS_DECODE_ENTRY if s_dirList holds an entry, FATFS_DECODE_SKIP if the entry is not listed.
+ */
+static uint8_t decode_directory_entry(const uint8_t *raw, uint32_t excluded_cluster, fatfs_lfn_struct_t *lfn)
+{
+    uint8_t result = FATFS_DECODE_SKIP;
+    /* Default result is an entry that is not listed */
+    uint16_t cluster_high = 0;
+    /* The high word of the first cluster, only meaningful on FAT32 */
+
+    /* Copy the file name, extension, attributes, creation time and date, last write time and date, first logical cluster,
+     and file size in bytes from the buffer to the directory list structure */
+    memcpy(&s_dirList.File_name, &raw[0], 8);
+    s_dirList.File_name[8] = '\0';
+    memcpy(&s_dirList.Extension, &raw[8], 3);
+    s_dirList.Extension[3] = '\0';
+    s_dirList.Extension[4] = '\0';
+    make_name_key(s_dirList.File_name, s_dirList.Extension, &s_dirList.Name_key);
+    memcpy(&s_dirList.Attributes, &raw[11], 1);
+    memcpy(&s_dirList.Creation_Time, &raw[14], 2);
+    memcpy(&s_dirList.Creation_Date, &raw[16], 2);
+    memcpy(&s_dirList.Last_Write_Time, &raw[22], 2);
+    memcpy(&s_dirList.Last_Write_Date, &raw[24], 2);
+    s_dirList.First_Logical_Cluster = 0;
+    memcpy(&s_dirList.First_Logical_Cluster, &raw[26], 2);
+    s_dirList.File_Size_in_bytes = 0;
+    memcpy(&s_dirList.File_Size_in_bytes, &raw[28], 4);
+    s_dirList.Long_name = lfn_finish(lfn, raw);
+
+    /* On FAT32 the upper 16 bits of the first cluster are stored separately */
+    if (FATFS_TYPE_FAT32 == s_FAT12Infor.Fat_type)
+    {
+        memcpy(&cluster_high, &raw[20], 2);
+        s_dirList.First_Logical_Cluster |= (uint32_t)cluster_high << 16;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Ignore if entry points to current directory */
+    if (0 == excluded_cluster || excluded_cluster != s_dirList.First_Logical_Cluster)
+    {
+        result = FATFS_DECODE_ENTRY;
+    }
+    else
+    {
+        /* Do nothing*/
+    }
+
+    return result;
+}
+
+/*
+ *@brief Get the first cluster of a short directory entry.
+ *@param raw - The 32 bytes of the entry.
+ *@returns Returns the first cluster, with its upper 16 bits on FAT32.
+ */
+static uint32_t raw_entry_first_cluster(const uint8_t *raw)
+{
+    uint32_t cluster = 0;
+    /* The first cluster of the entry */
+    uint16_t cluster_high = 0;
+    /* The high word of the first cluster, only meaningful on FAT32 */
+
+    memcpy(&cluster, &raw[26], 2);
+    if (FATFS_TYPE_FAT32 == s_FAT12Infor.Fat_type)
+    {
+        memcpy(&cluster_high, &raw[20], 2);
+        cluster |= (uint32_t)cluster_high << 16;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return cluster;
+}
+
+/*
+ *@brief Decode the next entry of the scanned group of an iterator, scanning the next group when the current one is used up.
+ *@param iterator - The directory iterator.
+ *@param decode - 1 to decode a short entry into s_dirList, 0 to point the view of the iterator at its raw bytes instead.
+ *@returns Returns FATFS_DECODE_ENTRY if s_dirList or the view holds an entry, FATFS_DECODE_SKIP if the entry is not listed,
+ *         FATFS_DECODE_END at the end of the directory.
+ */
+static uint8_t dir_iterator_scan(DirIterator *iterator, uint8_t decode)
+{
+    uint8_t result = FATFS_DECODE_SKIP;
+    /* Default result is an entry that is not listed */
+    uint32_t pending = (uint32_t)iterator->scan.Short | iterator->scan.Lfn | iterator->scan.End;
+    /* The entries of the group not decoded yet */
+    uint32_t count = 0;
+    /* The number of entries in the next group */
+    uint32_t k = 0;
+    /* The position of the next entry in the group */
+    uint32_t bit = 0;
+    /* The bit of the next entry in the masks */
+    const uint8_t *raw = NULL;
+    /* The next entry */
+
+    if (0 == pending)
+    {
+        /* Classify the next group, the position moves past it */
+        count = (iterator->buffer_length - iterator->position) / FATFS_DIRECTORY_ENTRY_SIZE;
+        count = (FATFS_SCAN_GROUP_ENTRIES < count) ? FATFS_SCAN_GROUP_ENTRIES : count;
+        scan_directory_entries(&iterator->buffer[iterator->position], count, &iterator->scan);
+        iterator->scan_position = iterator->position;
+        iterator->position = (0 != count) ? iterator->position + count * FATFS_DIRECTORY_ENTRY_SIZE : iterator->buffer_length;
+    }
+    else
+    {
+        /* Jump to the lowest pending entry */
+#if defined(__GNUC__)
+        k = (uint32_t)__builtin_ctz(pending);
+#else
+        while (0 == ((pending >> k) & 1))
+        {
+            k++;
+        }
+#endif
+        bit = 1U << k;
+        raw = &iterator->buffer[iterator->scan_position + k * FATFS_DIRECTORY_ENTRY_SIZE];
+
+        /* If the first byte of the Filename field is 0x00, then this directory entry is free and all the remaining directory entries in this directory are also free. */
+        if (0 != (iterator->scan.End & bit))
+        {
+            result = FATFS_DECODE_END;
+        }
+        /* If the Attributes byte is 0x0F, then this directory entry is part of a long file name and is collected for the short entry that follows it.
+        A deleted long file name entry breaks the sequence. */
+        else if (0 != (iterator->scan.Lfn & bit))
+        {
+            if (0 == (iterator->scan.Deleted & bit))
+            {
+                lfn_collect(&iterator->lfn, raw);
+            }
+            else
+            {
+                iterator->lfn.Active = 0;
+            }
+        }
+        else if (0 != decode)
+        {
+            result = decode_directory_entry(raw, iterator->excluded_cluster, &iterator->lfn);
+        }
+        else
+        {
+            /* Only the long name is assembled, the other fields are decoded by the accessors of the view */
+            iterator->view.Raw = raw;
+            iterator->view.Entry = NULL;
+            iterator->view.Long_name = lfn_finish(&iterator->lfn, raw);
+            if (0 == iterator->excluded_cluster || iterator->excluded_cluster != raw_entry_first_cluster(raw))
+            {
+                result = FATFS_DECODE_ENTRY;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+
+        /* The entry and the ones before it are done */
+        iterator->next_offset = iterator->scan_position + (k + 1) * FATFS_DIRECTORY_ENTRY_SIZE;
+        iterator->scan.Short &= (uint16_t)~((bit << 1) - 1U);
+        iterator->scan.Lfn &= (uint16_t)~((bit << 1) - 1U);
+        iterator->scan.End &= (uint16_t)~((bit << 1) - 1U);
+    }
+
+    return result;
+}
+
+/*
+ *@brief Read the next part of a directory into the buffer of an iterator.
+ *@param iterator - The directory iterator.
+ *@returns No return value. The end_of_directory flag is set when nothing is left to read.
+ */
+static void dir_iterator_load(DirIterator *iterator)
+{
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    uint32_t number_of_sectors = 0;
+    /* The number of sectors read from the fixed root directory region */
+    uint32_t number_of_bytes_read = 0;
+    /* Variable to store the number of bytes read */
+
+    iterator->position = 0;
+    iterator->buffer_length = 0;
+
+    /* An exFAT entry set may cross a cluster boundary, so the whole directory is read the first time */
+    if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+    {
+        if (0 != iterator->directory_cluster)
+        {
+            iterator->buffer = exfat_read_stream(iterator->directory_cluster, &iterator->buffer_length);
+
+            /* Check if the directory was read */
+            if (NULL == iterator->buffer || 0 == iterator->buffer_length)
+            {
+                error_callback((0 == iterator->parent_cluster) ? ERROR_READING_ROOT_DIRECTORY : ERROR_READING_SUB_DIRECTORY);
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            /* The directory has been read */
+            iterator->directory_cluster = 0;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    /* The fixed root directory region of FAT12 and FAT16 is read one cluster worth of sectors at a time */
+    else if (0 != iterator->remaining_sectors)
+    {
+        number_of_sectors = (iterator->remaining_sectors < s_FAT12Infor.sectors_per_cluster) ? iterator->remaining_sectors : s_FAT12Infor.sectors_per_cluster;
+        number_of_bytes_read = kmc_read_multi_sector((uint64_t)iterator->next_sector * s_FAT12Infor.bytes_per_sector, number_of_sectors, iterator->buffer);
+
+        /* Check if the correct number of bytes were read */
+        if (number_of_bytes_read == number_of_sectors * s_FAT12Infor.bytes_per_sector)
+        {
+            iterator->buffer_length = number_of_bytes_read;
+            iterator->next_sector += number_of_sectors;
+            iterator->remaining_sectors -= number_of_sectors;
+        }
+        else
+        {
+            /* If reading the root directory failed, call the error callback with the appropriate error code */
+            error_callback(ERROR_READING_ROOT_DIRECTORY);
+        }
+    }
+    /* A directory stored in a cluster chain is read one cluster at a time */
+    else if (iterator->extent_index < iterator->extent_count)
+    {
+        number_of_bytes_read = kmc_read_multi_sector(get_cluster_offset(iterator->extents[iterator->extent_index].First_cluster + iterator->cluster_index),
+                                                     s_FAT12Infor.sectors_per_cluster, iterator->buffer);
+
+        /* Check if the correct number of bytes were read */
+        if (number_of_bytes_read == Cluster_size)
+        {
+            iterator->buffer_length = number_of_bytes_read;
+
+            /* Move to the next cluster, in the same extent or at the start of the next one */
+            iterator->cluster_index++;
+            if (iterator->cluster_index == iterator->extents[iterator->extent_index].Cluster_count)
+            {
+                iterator->extent_index++;
+                iterator->cluster_index = 0;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+        else
+        {
+            /* If reading the subdirectory failed, call the error callback with the appropriate error code */
+            error_callback(ERROR_READING_SUB_DIRECTORY);
+        }
+    }
+    else
+    {
+        /* Do nothing, every cluster has been read */
+    }
+
+    /* Nothing was read, either because the directory is exhausted or because of an error */
+    if (0 == iterator->buffer_length)
+    {
+        iterator->end_of_directory = 1;
+    }
+    else
+    {
+        iterator->loaded_count++;
+    }
+}
+
+/*
+ *@brief Open a directory for reading one entry at a time.
+ *@param First_Logical_Directory_of_current - The first logical directory of the directory to open, 0 for the root directory.
+ *@returns Returns the directory iterator, or NULL if memory allocation failed.
+ */
+DirIterator *fatfs_opendir(uint32_t First_Logical_Directory_of_current)
+{
+    DirIterator *iterator = NULL;
+    /* The directory iterator returned to the caller */
+    fatfs_exfat_stream_struct_t *parent = NULL;
+    /* The stream table entry of an exFAT directory */
+
+    iterator = (DirIterator *)calloc(1, sizeof(DirIterator));
+
+    /* Check if memory allocation was successful */
+    if (NULL == iterator)
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+    /* exFAT directories are read whole by exfat_read_stream when the first entry is requested */
+    else if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+    {
+        if (0 != First_Logical_Directory_of_current && s_FAT12Infor.Root_cluster != First_Logical_Directory_of_current)
+        {
+            iterator->directory_cluster = First_Logical_Directory_of_current;
+            iterator->parent_cluster = First_Logical_Directory_of_current;
+
+            /* exFAT directories have no "." and ".." entries, synthesize ".." so that callers can navigate up as on FAT */
+            parent = exfat_find_stream(First_Logical_Directory_of_current);
+            memset(&iterator->entry, 0, sizeof(iterator->entry));
+            memcpy(iterator->entry.File_name, "..      ", 9);
+            memcpy(iterator->entry.Extension, "   ", 4);
+            make_name_key(iterator->entry.File_name, iterator->entry.Extension, &iterator->entry.Name_key);
+            iterator->entry.Attributes = 0x10;
+            iterator->entry.First_Logical_Cluster = (NULL != parent) ? parent->Parent_cluster : 0;
+            iterator->dot_dot_pending = 1;
+        }
+        else
+        {
+            /* Entries of the root directory are registered with parent 0 */
+            iterator->directory_cluster = s_FAT12Infor.Root_cluster;
+            iterator->parent_cluster = 0;
+        }
+    }
+    else
+    {
+        /* Allocate the buffer holding one cluster of the directory */
+        iterator->buffer = (uint8_t *)calloc(s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector, sizeof(uint8_t));
+
+        /* Check if memory allocation was successful */
+        if (NULL == iterator->buffer)
+        {
+            /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            free(iterator);
+            iterator = NULL;
+        }
+        /* Check if the directory is the root directory of a FAT12 or FAT16 volume, stored in a fixed region */
+        else if (0 == First_Logical_Directory_of_current && FATFS_TYPE_FAT32 != s_FAT12Infor.Fat_type)
+        {
+            iterator->next_sector = cluster_started_in_physical_of_rootdirectory;
+            iterator->remaining_sectors = num_cluster_in_root_directory;
+        }
+        else
+        {
+            /* The FAT32 root directory is a cluster chain like any subdirectory, but contains no entry for itself */
+            if (0 == First_Logical_Directory_of_current)
+            {
+                First_Logical_Directory_of_current = s_FAT12Infor.Root_cluster;
+                iterator->excluded_cluster = 0;
+            }
+            else
+            {
+                iterator->excluded_cluster = First_Logical_Directory_of_current;
+            }
+
+            /* Get every extent of the directory, from the chain cache when the directory was read before */
+            iterator->extents = get_cluster_extents(First_Logical_Directory_of_current, &iterator->extent_count);
+        }
+    }
+
+    return iterator;
+}
+
+/*
+ *@brief Move a new iterator to an entry of its directory and read the cluster holding it.
+ *@param iterator - The directory iterator, before its first entry was read.
+ *@param cluster_index - The position in the directory of the cluster holding the entry, in clusters of the fixed root directory
+ *       region on FAT12 and FAT16.
+ *@param entry_index - The position of the entry in the cluster.
+ *@returns No return value. The end_of_directory flag is set if the directory has fewer clusters.
+ */
+static void dir_iterator_seek(DirIterator *iterator, uint32_t cluster_index, uint32_t entry_index)
+{
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    uint32_t skipped = 0;
+    /* The number of clusters skipped */
+    uint32_t step = 0;
+    /* The number of clusters skipped in the current extent */
+
+    /* An exFAT directory is read whole, so the entry is found by its offset in the directory */
+    if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+    {
+        dir_iterator_load(iterator);
+        iterator->position = cluster_index * Cluster_size + entry_index * FATFS_DIRECTORY_ENTRY_SIZE;
+    }
+    else
+    {
+        /* Skip the clusters before the entry without reading them */
+        if (0 != iterator->remaining_sectors)
+        {
+            skipped = cluster_index * s_FAT12Infor.sectors_per_cluster;
+            skipped = (skipped < iterator->remaining_sectors) ? skipped : iterator->remaining_sectors;
+            iterator->next_sector += skipped;
+            iterator->remaining_sectors -= skipped;
+        }
+        else
+        {
+            while (skipped < cluster_index && iterator->extent_index < iterator->extent_count)
+            {
+                step = iterator->extents[iterator->extent_index].Cluster_count - iterator->cluster_index;
+                step = (cluster_index - skipped < step) ? cluster_index - skipped : step;
+                iterator->cluster_index += step;
+                skipped += step;
+                if (iterator->cluster_index == iterator->extents[iterator->extent_index].Cluster_count)
+                {
+                    iterator->extent_index++;
+                    iterator->cluster_index = 0;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+        }
+
+        iterator->loaded_count = cluster_index;
+        dir_iterator_load(iterator);
+        iterator->position = entry_index * FATFS_DIRECTORY_ENTRY_SIZE;
+    }
+
+    /* An offset past the end of the buffer moves on to the next cluster */
+    iterator->position = (iterator->position < iterator->buffer_length) ? iterator->position : iterator->buffer_length;
+}
+
+/*
+ *@brief Find the next listed entry of a directory, reading the next cluster whenever the buffer is used up.
+ *@param iterator - The directory iterator, past the synthesized exFAT ".." entry.
+ *@param decode - 1 to decode a FAT entry into s_dirList, 0 to point the view of the iterator at it. exFAT entries are always decoded.
+ *@returns Returns FATFS_DECODE_ENTRY if an entry was found, FATFS_DECODE_END at the end of the directory.
+ */
+static uint8_t dir_iterator_next(DirIterator *iterator, uint8_t decode)
+{
+    uint8_t status = FATFS_DECODE_SKIP;
+    /* The result of decoding the entry at the current position */
+
+    while (FATFS_DECODE_SKIP == status && 0 == iterator->end_of_directory)
+    {
+        if (iterator->position >= iterator->buffer_length && 0 == (iterator->scan.Short | iterator->scan.Lfn | iterator->scan.End))
+        {
+            dir_iterator_load(iterator);
+        }
+        else if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+        {
+            status = exfat_decode_entry_set(iterator->buffer, iterator->buffer_length, &iterator->position, iterator->parent_cluster, &iterator->lfn);
+            iterator->next_offset = iterator->position;
+        }
+        else
+        {
+            status = dir_iterator_scan(iterator, decode);
+        }
+    }
+
+    if (FATFS_DECODE_ENTRY != status)
+    {
+        /* The end-of-directory marker was found or nothing is left to read */
+        iterator->end_of_directory = 1;
+        status = FATFS_DECODE_END;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return status;
+}
+
+/*
+ *@brief Read the next entry of a directory.
+ *@param iterator - The directory iterator returned by fatfs_opendir.
+ *@returns Returns the next entry, valid until the next call, or NULL at the end of the directory.
+ */
+const fatfs_directory_entry_list_struct_t *fatfs_readdir(DirIterator *iterator)
+{
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The entry returned to the caller */
+
+    /* Check that the iterator is valid */
+    if (NULL == iterator)
+    {
+        /* Do nothing */
+    }
+    /* The synthesized exFAT ".." entry comes first */
+    else if (0 != iterator->dot_dot_pending)
+    {
+        iterator->dot_dot_pending = 0;
+        entry = &iterator->entry;
+    }
+    else if (FATFS_DECODE_ENTRY == dir_iterator_next(iterator, 1))
+    {
+        /* Copy the decoded entry into the iterator, so that the caller can keep it until the next call */
+        memcpy(&iterator->entry, &s_dirList, sizeof(fatfs_directory_entry_list_struct_t));
+        entry = &iterator->entry;
+    }
+    else
+    {
+        /* Do nothing, the end of the directory was reached */
+    }
+
+    return entry;
+}
+
+/*
+ *@brief Read the next entry of a directory as a view of its raw bytes.
+ *@param iterator - The directory iterator returned by fatfs_opendir.
+ *@returns Returns the view of the next entry, valid until the next call, or NULL at the end of the directory.
+ */
+const fatfs_entry_view_struct_t *fatfs_readdir_view(DirIterator *iterator)
+{
+    const fatfs_entry_view_struct_t *view = NULL;
+    /* The view returned to the caller */
+
+    /* Check that the iterator is valid */
+    if (NULL == iterator)
+    {
+        /* Do nothing */
+    }
+    /* The synthesized exFAT ".." entry comes first, it has no raw bytes */
+    else if (0 != iterator->dot_dot_pending)
+    {
+        iterator->dot_dot_pending = 0;
+        iterator->view.Raw = NULL;
+        iterator->view.Entry = &iterator->entry;
+        iterator->view.Long_name = NULL;
+        view = &iterator->view;
+    }
+    else if (FATFS_DECODE_ENTRY == dir_iterator_next(iterator, 0))
+    {
+        /* An exFAT entry set is decoded to check it and to register the stream of the file, so the decoded entry is kept */
+        if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+        {
+            memcpy(&iterator->entry, &s_dirList, sizeof(fatfs_directory_entry_list_struct_t));
+            iterator->view.Raw = NULL;
+            iterator->view.Entry = &iterator->entry;
+            iterator->view.Long_name = iterator->entry.Long_name;
+        }
+        else
+        {
+            /* Do nothing, the scan has pointed the view at the entry */
+        }
+        view = &iterator->view;
+    }
+    else
+    {
+        /* Do nothing, the end of the directory was reached */
+    }
+
+    return view;
+}
+
+/*
+ *@brief Get the attributes of a viewed entry.
+ *@param view - The view returned by fatfs_readdir_view.
+ *@returns Returns the attribute byte.
+ */
+uint8_t fatfs_view_attributes(const fatfs_entry_view_struct_t *view)
+{
+    return (NULL != view->Raw) ? view->Raw[11] : view->Entry->Attributes;
+}
+
+/*
+ *@brief Get the first cluster of a viewed entry.
+ *@param view - The view returned by fatfs_readdir_view.
+ *@returns Returns the first cluster, 0 for an empty file.
+ */
+uint32_t fatfs_view_first_cluster(const fatfs_entry_view_struct_t *view)
+{
+    return (NULL != view->Raw) ? raw_entry_first_cluster(view->Raw) : view->Entry->First_Logical_Cluster;
+}
+
+/*
+ *@brief Get the size of a viewed entry.
+ *@param view - The view returned by fatfs_readdir_view.
+ *@returns Returns the size in bytes.
+ */
+uint64_t fatfs_view_size(const fatfs_entry_view_struct_t *view)
+{
+    uint32_t size = 0;
+    /* The 32-bit size stored in a FAT entry */
+    uint64_t result = 0;
+    /* The size of the entry */
+
+    if (NULL != view->Raw)
+    {
+        memcpy(&size, &view->Raw[28], 4);
+        result = size;
+    }
+    else
+    {
+        result = view->Entry->File_Size_in_bytes;
+    }
+
+    return result;
+}
+
+/*
+ *@brief Decode a date and time of a viewed entry.
+ *@param view - The view returned by fatfs_readdir_view.
+ *@param field - The date and time to decode.
+ *@param timestamp - Receives the decoded date and time.
+ *@returns No return value.
+ */
+void fatfs_view_timestamp(const fatfs_entry_view_struct_t *view, FATFS_TIMESTAMP_FIELD field, fatfs_timestamp_struct_t *timestamp)
+{
+    uint16_t date = 0;
+    /* The stored date */
+    uint16_t time = 0;
+    /* The stored time */
+
+    if (NULL != view->Raw)
+    {
+        memcpy(&date, &view->Raw[(FATFS_TIMESTAMP_CREATED == field) ? 16 : 24], 2);
+        memcpy(&time, &view->Raw[(FATFS_TIMESTAMP_CREATED == field) ? 14 : 22], 2);
+    }
+    else
+    {
+        date = (FATFS_TIMESTAMP_CREATED == field) ? view->Entry->Creation_Date : view->Entry->Last_Write_Date;
+        time = (FATFS_TIMESTAMP_CREATED == field) ? view->Entry->Creation_Time : view->Entry->Last_Write_Time;
+    }
+
+    fatfs_decode_timestamp(date, time, timestamp);
+}
+
+/*
+ *@brief Format the 8.3 name of a viewed entry as "NAME.EXT".
+ *@param view - The view returned by fatfs_readdir_view.
+ *@param name - Receives the name, at least 13 characters.
+ *@returns Returns the length of the name.
+ */
+uint32_t fatfs_view_short_name(const fatfs_entry_view_struct_t *view, char *name)
+{
+    return (NULL != view->Raw) ? format_short_name((const char *)view->Raw, (const char *)&view->Raw[8], name)
+                               : format_short_name(view->Entry->File_name, view->Entry->Extension, name);
+}
+
+/*
+ *@brief Close a directory iterator.
+ *@param iterator - The directory iterator returned by fatfs_opendir, or NULL.
+ *@returns No return value.
+ */
+void fatfs_closedir(DirIterator *iterator)
+{
+    /* Check that the iterator is valid */
+    if (NULL != iterator)
+    {
+        free(iterator->buffer);
+        free(iterator->extents);
+        free(iterator);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/*
+ *@brief Build the lookup key of a path component, padded like an 8.3 directory entry.
+ *@param component - The path component, not terminated.
+ *@param length - The number of characters in the component.
+ *@param key - Receives the packed name.
+ *@returns Returns 1 if the component is a valid 8.3 name, 0 otherwise.
+ */
+static uint8_t make_path_name_key(const char *component, uint32_t length, fatfs_name_key_struct_t *key)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (valid) */
+    char padded[FATFS_NAME_KEY_LENGTH];
+    /* The component padded like an 8.3 directory entry */
+    uint32_t dot = length;
+    /* Position of the dot that separates the extension, length if there is none */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* "." and ".." are names of their own, otherwise the last dot separates the extension */
+    if (!((1 == length || 2 == length) && '.' == component[0] && '.' == component[length - 1]))
+    {
+        for (i = 1; i < length; i++)
+        {
+            if ('.' == component[i])
+            {
+                dot = i;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Names longer than 8.3 are never found */
+    if (8 < dot || (length > dot && 3 < length - dot - 1))
+    {
+        result = 0;
+    }
+    else
+    {
+        memset(padded, ' ', FATFS_NAME_KEY_LENGTH);
+        memcpy(padded, component, dot);
+        if (length > dot)
+        {
+            memcpy(&padded[8], &component[dot + 1], length - dot - 1);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        make_name_key(padded, &padded[8], key);
+    }
+
+    return result;
+}
+
+/*
+ *@brief Get the slot of the dentry cache for a name in a directory.
+ *@param parent_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param key - The lookup key of the name.
+ *@returns Returns the index of the slot.
+ */
+static uint32_t dentry_slot(uint32_t parent_cluster, const fatfs_name_key_struct_t *key)
+{
+    return (FATFS_NAME_KEY_HASH(*key) ^ (parent_cluster * 2654435761U)) & (FATFS_DENTRY_CACHE_SIZE - 1);
+}
+
+/*
+ *@brief Remove every entry from the dentry cache.
+ *@param None.
+ *@returns No return value.
+ */
+static void dentry_flush(void)
+{
+    memset(s_dentry_cache, 0, sizeof(s_dentry_cache));
+    s_dentry_generation = s_generation;
+}
+
+/*
+ *@brief Release the tree index.
+ *@param None.
+ *@returns No return value.
+ */
+static void tree_index_release(void)
+{
+    free(s_tree_nodes);
+    s_tree_nodes = NULL;
+    s_tree_node_count = 0;
+    s_tree_node_capacity = 0;
+    free(s_tree_directories);
+    s_tree_directories = NULL;
+    s_tree_directory_capacity = 0;
+    s_tree_directory_count = 0;
+    name_arena_release(s_tree_names);
+    s_tree_names = NULL;
+}
+
+/*
+ *@brief Find the node of a directory in the tree index.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@returns Returns the index of the node plus one, or 0 if the directory is not in the tree index.
+ */
+static uint32_t tree_index_find_directory(uint32_t first_cluster)
+{
+    uint32_t result = 0;
+    /* Default result is 0 (not found) */
+    uint32_t probe = 0;
+    /* The slot being probed */
+
+    if (0 != s_tree_directory_capacity)
+    {
+        probe = (first_cluster * 2654435761U) & (s_tree_directory_capacity - 1);
+        while (0 != s_tree_directories[probe] && 0 == result)
+        {
+            if (s_tree_nodes[s_tree_directories[probe] - 1].Entry.First_Logical_Cluster == first_cluster)
+            {
+                result = s_tree_directories[probe];
+            }
+            else
+            {
+                probe = (probe + 1) & (s_tree_directory_capacity - 1);
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Add the node of a directory to the directory table of the tree index.
+ *@param node - The index of the node.
+ *@returns Returns 1 if the directory was added, 0 if it is already in the table, 2 if memory allocation failed.
+ */
+static uint8_t tree_index_add_directory(uint32_t node)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not added) */
+    uint32_t *old_directories = s_tree_directories;
+    /* The table before it is grown */
+    uint32_t old_capacity = s_tree_directory_capacity;
+    /* The number of slots before the table is grown */
+    uint32_t probe = 0;
+    /* The slot being probed */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Grow the table to keep it at most half full, rehashing the directories already added */
+    if (2 * (s_tree_directory_count + 1) > s_tree_directory_capacity)
+    {
+        s_tree_directory_capacity = (0 == old_capacity) ? 64 : old_capacity * 2;
+        s_tree_directories = (uint32_t *)calloc(s_tree_directory_capacity, sizeof(uint32_t));
+
+        if (NULL != s_tree_directories)
+        {
+            for (i = 0; i < old_capacity; i++)
+            {
+                if (0 != old_directories[i])
+                {
+                    probe = (s_tree_nodes[old_directories[i] - 1].Entry.First_Logical_Cluster * 2654435761U) & (s_tree_directory_capacity - 1);
+                    while (0 != s_tree_directories[probe])
+                    {
+                        probe = (probe + 1) & (s_tree_directory_capacity - 1);
+                    }
+                    s_tree_directories[probe] = old_directories[i];
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            free(old_directories);
+        }
+        else
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            s_tree_directories = old_directories;
+            s_tree_directory_capacity = old_capacity;
+            result = 2;
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* A directory reached twice (a cycle in a damaged volume) is indexed only once */
+    if (2 != result && 0 == tree_index_find_directory(s_tree_nodes[node].Entry.First_Logical_Cluster))
+    {
+        probe = (s_tree_nodes[node].Entry.First_Logical_Cluster * 2654435761U) & (s_tree_directory_capacity - 1);
+        while (0 != s_tree_directories[probe])
+        {
+            probe = (probe + 1) & (s_tree_directory_capacity - 1);
+        }
+        s_tree_directories[probe] = node + 1;
+        s_tree_directory_count++;
+        result = 1;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Build the tree index of the whole volume.
+ *@param None.
+ *@returns Returns 1 if the tree index was built, 0 otherwise.
+ */
+static uint8_t tree_index_build(void)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (built) */
+    fatfs_tree_node_struct_t *grown = NULL;
+    /* The node array after it has grown */
+    DirIterator *iterator = NULL;
+    /* The iterator reading a directory */
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The entry read from the directory */
+    uint32_t node = 0;
+    /* The node being expanded */
+    uint8_t added = 0;
+    /* Whether the directory of the node was added to the directory table */
+
+    tree_index_release();
+
+    /* The node array is also the work queue: directories are expanded in the order their nodes were added */
+    s_tree_node_capacity = 64;
+    s_tree_nodes = (fatfs_tree_node_struct_t *)calloc(s_tree_node_capacity, sizeof(fatfs_tree_node_struct_t));
+
+    if (NULL != s_tree_nodes)
+    {
+        /* The root directory has no entry of its own */
+        memset(s_tree_nodes[0].Entry.File_name, ' ', 8);
+        memset(s_tree_nodes[0].Entry.Extension, ' ', 3);
+        make_name_key(s_tree_nodes[0].Entry.File_name, s_tree_nodes[0].Entry.Extension, &s_tree_nodes[0].Entry.Name_key);
+        s_tree_nodes[0].Entry.Attributes = 0x10;
+        s_tree_node_count = 1;
+    }
+    else
+    {
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+        result = 0;
+    }
+
+    for (node = 0; node < s_tree_node_count && 0 != result; node++)
+    {
+        /* Expand directories, but not the "." and ".." entries and not a directory already expanded */
+        if (0 != ((s_tree_nodes[node].Entry.Attributes >> 4) & 1) && '.' != s_tree_nodes[node].Entry.File_name[0])
+        {
+            added = tree_index_add_directory(node);
+        }
+        else
+        {
+            added = 0;
+        }
+
+        if (2 == added)
+        {
+            result = 0;
+        }
+        else if (1 == added)
+        {
+            /* The entries of a directory are stored next to each other */
+            s_tree_nodes[node].First_child = s_tree_node_count;
+            iterator = fatfs_opendir(s_tree_nodes[node].Entry.First_Logical_Cluster);
+            entry = fatfs_readdir(iterator);
+            while (NULL != entry && 0 != result)
+            {
+                if (s_tree_node_count == s_tree_node_capacity)
+                {
+                    grown = (fatfs_tree_node_struct_t *)realloc(s_tree_nodes, 2 * s_tree_node_capacity * sizeof(fatfs_tree_node_struct_t));
+                    if (NULL != grown)
+                    {
+                        s_tree_nodes = grown;
+                        s_tree_node_capacity *= 2;
+                    }
+                    else
+                    {
+                        error_callback(DYNAMIC_ALLOCATON_ERROR);
+                        result = 0;
+                    }
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+
+                if (0 != result)
+                {
+                    memcpy(&s_tree_nodes[s_tree_node_count].Entry, entry, sizeof(fatfs_directory_entry_list_struct_t));
+                    if (NULL != entry->Long_name)
+                    {
+                        s_tree_nodes[s_tree_node_count].Entry.Long_name = name_arena_store(&s_tree_names, entry->Long_name);
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+                    s_tree_nodes[s_tree_node_count].Parent = node;
+                    s_tree_nodes[s_tree_node_count].First_child = 0;
+                    s_tree_nodes[s_tree_node_count].Child_count = 0;
+                    s_tree_node_count++;
+                    s_tree_nodes[node].Child_count++;
+                    entry = fatfs_readdir(iterator);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            fatfs_closedir(iterator);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    /* A partial tree would answer listings wrongly, so it is dropped */
+    if (0 == result)
+    {
+        tree_index_release();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Continue the FNV-1a hash of a block of bytes.
+ *@param hash - The hash of the bytes before the block.
+ *@param data - The bytes of the block.
+ *@param size - The number of bytes of the block.
+ *@returns Returns the hash of the bytes before the block followed by the block.
+ */
+static uint64_t snapshot_hash(uint64_t hash, const uint8_t *data, uint32_t size)
+{
+    uint32_t i = 0;
+    /* Loop counter */
+
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+/*
+ *@brief Read the FAT from the image and load the tree index from the mount snapshot.
+ *@details The FAT is read with a single range read and its hash must match the one recorded in the snapshot,
+ *         so that a directory rewritten without changing the stamp of the image is not served from a stale index.
+ *@param None.
+ *@returns Returns 1 if the snapshot describes the mounted image and was loaded, 0 otherwise.
+ */
+static uint8_t snapshot_load(void)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not loaded) */
+    uint8_t *buff = NULL;
+    /* The contents of the snapshot */
+    uint32_t size = 0;
+    /* The number of bytes of the snapshot */
+    fatfs_snapshot_header_struct_t header;
+    /* The header of the snapshot */
+    const uint8_t *nodes = NULL;
+    /* The nodes of the tree index in the snapshot */
+    const uint8_t *offsets = NULL;
+    /* The name offsets of the nodes in the snapshot */
+    const char *names = NULL;
+    /* The long names in the snapshot */
+    uint32_t offset = 0;
+    /* The name offset of a node */
+    uint32_t node = 0;
+    /* Loop counter */
+
+    /* exFAT stream extents are recorded while directories are decoded, so exFAT volumes are always read from the image */
+    if (FATFS_TYPE_EXFAT != s_FAT12Infor.Fat_type)
+    {
+        buff = kmc_load_side_file(FATFS_SNAPSHOT_SUFFIX, &size);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (NULL != buff && sizeof(header) <= size)
+    {
+        memcpy(&header, buff, sizeof(header));
+
+        /* The snapshot must be complete, of this layout, and taken from the image as it is now */
+        if (0 == memcmp(header.Magic, FATFS_SNAPSHOT_MAGIC, sizeof(header.Magic)) && FATFS_SNAPSHOT_VERSION == header.Version &&
+            sizeof(fatfs_tree_node_struct_t) == header.Node_size && header.Image_size == s_image_stamp.size &&
+            header.Image_mtime == s_image_stamp.mtime && header.Image_mtime_nsec == s_image_stamp.mtime_nsec && header.Image_inode == s_image_stamp.inode &&
+            header.Boot_hash == snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, s_boot_sector, KMC_DEFAULT_SECTOR_SIZE) &&
+            header.Fat_size == (uint32_t)s_FAT12Infor.bytes_per_sector * s_FAT12Infor.Sectors_per_FAT && 0 != header.Node_count &&
+            (uint64_t)size == (uint64_t)sizeof(header) + (uint64_t)header.Node_count * (sizeof(fatfs_tree_node_struct_t) + sizeof(uint32_t)) + header.Names_size)
+        {
+            /* The FAT is read from the image in any case, and it must be the FAT the snapshot was taken with */
+            get_fat_table();
+
+            if (NULL != s_fat_table && header.Fat_hash == snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, s_fat_table, header.Fat_size) &&
+                header.Payload_hash == snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, &buff[sizeof(header)], size - (uint32_t)sizeof(header)) &&
+                (0 == header.Names_size || '\0' == (char)buff[size - 1]))
+            {
+                nodes = &buff[sizeof(header)];
+                offsets = &nodes[header.Node_count * sizeof(fatfs_tree_node_struct_t)];
+                names = (const char *)&offsets[header.Node_count * sizeof(uint32_t)];
+                s_tree_nodes = (fatfs_tree_node_struct_t *)malloc(header.Node_count * sizeof(fatfs_tree_node_struct_t));
+                result = (NULL != s_tree_nodes) ? 1 : 0;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (0 != result)
+    {
+        memcpy(s_tree_nodes, nodes, header.Node_count * sizeof(fatfs_tree_node_struct_t));
+        s_tree_node_count = header.Node_count;
+        s_tree_node_capacity = header.Node_count;
+
+        for (node = 0; node < s_tree_node_count && 0 != result; node++)
+        {
+            /* Links outside the node array mean the snapshot is damaged */
+            if (s_tree_nodes[node].Parent >= s_tree_node_count || s_tree_nodes[node].First_child > s_tree_node_count ||
+                s_tree_nodes[node].Child_count > s_tree_node_count - s_tree_nodes[node].First_child)
+            {
+                result = 0;
+            }
+            else
+            {
+                memcpy(&offset, &offsets[node * sizeof(uint32_t)], sizeof(uint32_t));
+                s_tree_nodes[node].Entry.Long_name = NULL;
+                if (0 != offset && offset <= header.Names_size)
+                {
+                    s_tree_nodes[node].Entry.Long_name = name_arena_store(&s_tree_names, &names[offset - 1]);
+                    result = (NULL != s_tree_nodes[node].Entry.Long_name) ? 1 : 0;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+
+            /* The directory table is rebuilt for the directories tree_index_build expanded */
+            if (0 != result && 0 != ((s_tree_nodes[node].Entry.Attributes >> 4) & 1) && '.' != s_tree_nodes[node].Entry.File_name[0] &&
+                2 == tree_index_add_directory(node))
+            {
+                result = 0;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Nothing of a snapshot that could not be loaded is kept, the directories are then read from the image */
+    if (0 == result)
+    {
+        tree_index_release();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    free(buff);
+
+    return result;
+}
+
+/*
+ *@brief Write the tree index to the mount snapshot, with the hash of the FAT it was built from.
+ *@details Does nothing unless the volume was mounted with FATFS_MOUNT_SNAPSHOT. A snapshot that cannot be written is not an
+ *         error: the next mount reads the image.
+ *@param None.
+ *@returns No return value.
+ */
+static void snapshot_save(void)
+{
+    fatfs_snapshot_header_struct_t header;
+    /* The header of the snapshot */
+    uint8_t *buff = NULL;
+    /* The contents of the snapshot */
+    uint8_t *nodes = NULL;
+    /* The nodes of the tree index in the snapshot */
+    fatfs_tree_node_struct_t copy;
+    /* A node as it is stored in the snapshot */
+    uint8_t *offsets = NULL;
+    /* The name offsets of the nodes in the snapshot */
+    char *names = NULL;
+    /* The long names in the snapshot */
+    uint64_t size = 0;
+    /* The number of bytes of the snapshot */
+    uint32_t offset = 0;
+    /* The name offset of a node */
+    uint32_t length = 0;
+    /* The number of bytes of a long name with its terminating '\0' */
+    uint32_t node = 0;
+    /* Loop counter */
+
+    /* Nothing is written beside the image unless the caller asked for snapshots */
+    if (0 != (s_mount_options & FATFS_MOUNT_SNAPSHOT) && FATFS_TYPE_EXFAT != s_FAT12Infor.Fat_type && NULL != s_fat_table && NULL != s_tree_nodes)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.Magic, FATFS_SNAPSHOT_MAGIC, sizeof(header.Magic));
+        header.Version = FATFS_SNAPSHOT_VERSION;
+        header.Node_size = sizeof(fatfs_tree_node_struct_t);
+        header.Image_size = s_image_stamp.size;
+        header.Image_mtime = s_image_stamp.mtime;
+        header.Image_mtime_nsec = s_image_stamp.mtime_nsec;
+        header.Image_inode = s_image_stamp.inode;
+        header.Boot_hash = snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, s_boot_sector, KMC_DEFAULT_SECTOR_SIZE);
+        header.Fat_size = (uint32_t)s_FAT12Infor.bytes_per_sector * s_FAT12Infor.Sectors_per_FAT;
+        header.Fat_hash = snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, s_fat_table, header.Fat_size);
+        header.Node_count = s_tree_node_count;
+        for (node = 0; node < s_tree_node_count; node++)
+        {
+            if (NULL != s_tree_nodes[node].Entry.Long_name)
+            {
+                header.Names_size += (uint32_t)strlen(s_tree_nodes[node].Entry.Long_name) + 1;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+
+        size = (uint64_t)sizeof(header) + (uint64_t)header.Node_count * (sizeof(fatfs_tree_node_struct_t) + sizeof(uint32_t)) + header.Names_size;
+        if (size <= UINT32_MAX)
+        {
+            buff = (uint8_t *)malloc((size_t)size);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (NULL != buff)
+        {
+            nodes = &buff[sizeof(header)];
+            offsets = &nodes[header.Node_count * sizeof(fatfs_tree_node_struct_t)];
+            names = (char *)&offsets[header.Node_count * sizeof(uint32_t)];
+
+            /* Pointers are meaningless in the file, so long names are stored as offsets into the name area */
+            length = 0;
+            for (node = 0; node < s_tree_node_count; node++)
+            {
+                copy = s_tree_nodes[node];
+                copy.Entry.Long_name = NULL;
+                memcpy(&nodes[node * sizeof(fatfs_tree_node_struct_t)], &copy, sizeof(fatfs_tree_node_struct_t));
+                offset = 0;
+                if (NULL != s_tree_nodes[node].Entry.Long_name)
+                {
+                    offset = length + 1;
+                    strcpy(&names[length], s_tree_nodes[node].Entry.Long_name);
+                    length += (uint32_t)strlen(s_tree_nodes[node].Entry.Long_name) + 1;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+                memcpy(&offsets[node * sizeof(uint32_t)], &offset, sizeof(uint32_t));
+            }
+
+            header.Payload_hash = snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, &buff[sizeof(header)], (uint32_t)size - (uint32_t)sizeof(header));
+            memcpy(buff, &header, sizeof(header));
+            kmc_store_side_file(FATFS_SNAPSHOT_SUFFIX, buff, (uint32_t)size);
+            free(buff);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/*
+ *@brief Release the listing and index held by a slot of the directory cache.
+ *@param slot - The slot of the directory cache.
+ *@returns No return value.
+ */
+static void dir_cache_release(fatfs_dir_cache_struct_t *slot)
+{
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* The dentries of the directory point to long names stored with the listing */
+    for (i = 0; NULL != slot->Listing && i < FATFS_DENTRY_CACHE_SIZE; i++)
+    {
+        if (s_dentry_cache[i].Parent_cluster == slot->First_cluster)
+        {
+            s_dentry_cache[i].Valid = 0;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    deallocate_Dir_Array(slot->Listing);
+    free(slot->Index);
+    memset(slot, 0, sizeof(fatfs_dir_cache_struct_t));
+}
+
+/*
+ *@brief Get the indexed listing of a directory, reading the directory and building its index on first use.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@returns Returns the slot of the directory cache holding the directory, or NULL if it could not be read.
+ */
+static fatfs_dir_cache_struct_t *dir_cache_get(uint32_t first_cluster)
+{
+    fatfs_dir_cache_struct_t *slot = NULL;
+    /* The slot holding the directory */
+    fatfs_dir_cache_struct_t *victim = &s_dir_cache[0];
+    /* The least recently used slot, replaced on a miss */
+    const fatfs_name_key_struct_t *key = NULL;
+    /* The packed name of an entry */
+    uint32_t probe = 0;
+    /* The index slot being probed */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    s_dir_cache_clock++;
+
+    /* Find the directory among the cached ones, or the slot to replace */
+    for (i = 0; i < FATFS_DIR_CACHE_SLOTS && NULL == slot; i++)
+    {
+        /* Listings read before a change to the image may be stale */
+        if (NULL != s_dir_cache[i].Listing && s_dir_cache[i].Generation != s_generation)
+        {
+            dir_cache_release(&s_dir_cache[i]);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (NULL != s_dir_cache[i].Listing && s_dir_cache[i].First_cluster == first_cluster)
+        {
+            slot = &s_dir_cache[i];
+        }
+        else if (s_dir_cache[i].Last_used < victim->Last_used)
+        {
+            victim = &s_dir_cache[i];
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    /* Cache miss: read the directory and index every entry by name */
+    if (NULL == slot)
+    {
+        dir_cache_release(victim);
+        victim->Listing = fatfs_read_dir_array(first_cluster);
+
+        if (NULL != victim->Listing)
+        {
+            /* Keep the index at most half full so that probe sequences stay short */
+            victim->Index_size = FATFS_DIR_INDEX_MINIMUM_SIZE;
+            while (victim->Index_size < 2 * victim->Listing->count)
+            {
+                victim->Index_size *= 2;
+            }
+            /* The index refers to the entries, whose packed names are compared directly */
+            victim->Index = (uint32_t *)calloc(victim->Index_size, sizeof(uint32_t));
+
+            if (NULL != victim->Index)
+            {
+                for (i = 0; i < victim->Listing->count; i++)
+                {
+                    /* Linear probing; the first entry with a name wins, as in a linear scan */
+                    key = &victim->Listing->entries[i].Name_key;
+                    probe = FATFS_NAME_KEY_HASH(*key) & (victim->Index_size - 1);
+                    while (0 != victim->Index[probe] && !FATFS_NAME_KEY_EQUAL(FATFS_DIR_CACHE_ENTRY(victim, probe)->Name_key, *key))
+                    {
+                        probe = (probe + 1) & (victim->Index_size - 1);
+                    }
+                    if (0 == victim->Index[probe])
+                    {
+                        victim->Index[probe] = i + 1;
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+                }
+
+                victim->First_cluster = first_cluster;
+                victim->Generation = s_generation;
+                slot = victim;
+            }
+            else
+            {
+                /* If memory allocation failed, call the error callback with the appropriate error code */
+                error_callback(DYNAMIC_ALLOCATON_ERROR);
+                dir_cache_release(victim);
+            }
+        }
+        else
+        {
+            /* Do nothing, the error callback has already been called */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (NULL != slot)
+    {
+        slot->Last_used = s_dir_cache_clock;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return slot;
+}
+
+/*
+ *@brief Find a name in a directory through the index of its cached listing.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param key - The lookup key of the name.
+ *@param entry - Receives the directory entry if it is found.
+ *@returns Returns 1 if the name was found, 0 otherwise.
+ */
+static uint8_t dir_cache_lookup(uint32_t first_cluster, const fatfs_name_key_struct_t *key, fatfs_directory_entry_list_struct_t *entry)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not found) */
+    fatfs_dir_cache_struct_t *slot = dir_cache_get(first_cluster);
+    /* The cached listing of the directory */
+    uint32_t probe = 0;
+    /* The index slot being probed */
+
+    if (NULL != slot)
+    {
+        /* Probe until the name or an empty slot is found */
+        probe = FATFS_NAME_KEY_HASH(*key) & (slot->Index_size - 1);
+        while (0 != slot->Index[probe] && 0 == result)
+        {
+            if (FATFS_NAME_KEY_EQUAL(FATFS_DIR_CACHE_ENTRY(slot, probe)->Name_key, *key))
+            {
+                memcpy(entry, FATFS_DIR_CACHE_ENTRY(slot, probe), sizeof(fatfs_directory_entry_list_struct_t));
+                result = 1;
+            }
+            else
+            {
+                probe = (probe + 1) & (slot->Index_size - 1);
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Find a long name in a directory by scanning its cached listing, ignoring the case of ASCII letters.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param name - The long name, not necessarily terminated.
+ *@param length - The number of characters of the name.
+ *@param entry - Receives the directory entry if it is found.
+ *@returns Returns 1 if the name was found, 0 otherwise.
+ */
+static uint8_t dir_cache_lookup_long_name(uint32_t first_cluster, const char *name, uint32_t length, fatfs_directory_entry_list_struct_t *entry)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not found) */
+    fatfs_dir_cache_struct_t *slot = dir_cache_get(first_cluster);
+    /* The cached listing of the directory */
+    const char *long_name = NULL;
+    /* The long name of the entry being compared */
+    uint32_t i = 0;
+    /* Loop counter */
+    uint32_t j = 0;
+    /* Position in the names */
+
+    for (i = 0; NULL != slot && i < slot->Listing->count && 0 == result; i++)
+    {
+        long_name = slot->Listing->entries[i].Long_name;
+        if (NULL != long_name)
+        {
+            j = 0;
+            while (j < length && '\0' != long_name[j] && tolower((unsigned char)long_name[j]) == tolower((unsigned char)name[j]))
+            {
+                j++;
+            }
+            if (j == length && '\0' == long_name[j])
+            {
+                memcpy(entry, &slot->Listing->entries[i], sizeof(fatfs_directory_entry_list_struct_t));
+                result = 1;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    return result;
+}
+
+/*
+ *@brief Find a name in a directory, through the dentry cache.
+ *@param parent_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param key - The lookup key of the name.
+ *@param entry - Receives the directory entry if it is found.
+ *@returns Returns 1 if the name was found, 0 otherwise.
+ */
+static uint8_t dentry_lookup(uint32_t parent_cluster, const fatfs_name_key_struct_t *key, fatfs_directory_entry_list_struct_t *entry)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not found) */
+    fatfs_dentry_struct_t *dentry = NULL;
+    /* The slot of the cache */
+
+    /* Entries cached before a change to the image may be stale */
+    if (s_dentry_generation != s_generation)
+    {
+        dentry_flush();
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    dentry = &s_dentry_cache[dentry_slot(parent_cluster, key)];
+    if (0 != dentry->Valid && dentry->Parent_cluster == parent_cluster && FATFS_NAME_KEY_EQUAL(dentry->Key, *key))
+    {
+        memcpy(entry, &dentry->Entry, sizeof(fatfs_directory_entry_list_struct_t));
+        result = 1;
+    }
+    else
+    {
+        /* Cache miss: look the name up in the indexed listing of the directory */
+        result = dir_cache_lookup(parent_cluster, key, entry);
+        if (0 != result)
+        {
+            dentry->Valid = 1;
+            dentry->Parent_cluster = parent_cluster;
+            dentry->Key = *key;
+            memcpy(&dentry->Entry, entry, sizeof(fatfs_directory_entry_list_struct_t));
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    return result;
+}
+
+/*
+ *@brief Check whether an entry is the "." or ".." entry of a directory.
+ *@param entry - The directory entry.
+ *@returns Returns 1 for the "." and ".." entries, 0 otherwise.
+ */
+static uint8_t is_dot_entry(const fatfs_directory_entry_list_struct_t *entry)
+{
+    return ('.' == entry->File_name[0] && (' ' == entry->File_name[1] || ('.' == entry->File_name[1] && ' ' == entry->File_name[2]))) ? 1 : 0;
+}
+
+/*
+ *@brief Format an 8.3 name as "NAME.EXT", without the padding spaces.
+ *@param file_name - The 8 characters of the name.
+ *@param extension - The 3 characters of the extension.
+ *@param name - Receives the name, at least FATFS_SHORT_NAME_MAX_LENGTH + 1 characters.
+ *@returns Returns the length of the name.
+ */
+static uint32_t format_short_name(const char *file_name, const char *extension, char *name)
+{
+    uint32_t length = 0;
+    /* The length of the name */
+    uint32_t base_length = 8;
+    /* The length of the base name without its padding */
+    uint32_t extension_length = 3;
+    /* The length of the extension without its padding */
+
+    while (0 != base_length && ' ' == file_name[base_length - 1])
+    {
+        base_length--;
+    }
+    while (0 != extension_length && ' ' == extension[extension_length - 1])
+    {
+        extension_length--;
+    }
+
+    memcpy(name, file_name, base_length);
+    length = base_length;
+    if (0 != extension_length)
+    {
+        name[length] = '.';
+        memcpy(&name[length + 1], extension, extension_length);
+        length += 1 + extension_length;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    name[length] = '\0';
+
+    return length;
+}
+
+/*
+ *@brief Match a name against a pattern with '*' and '?' wildcards, ignoring the case of ASCII letters.
+ *@param pattern - The pattern.
+ *@param name - The name.
+ *@returns Returns 1 if the name matches, 0 otherwise.
+ */
+static uint8_t find_match_pattern(const char *pattern, const char *name)
+{
+    uint8_t result = 2;
+    /* 2 until the match is decided */
+    const char *star = NULL;
+    /* The pattern after the last '*' seen */
+    const char *resume = NULL;
+    /* The character of the name the last '*' currently stops before */
+
+    /* Greedy matching that backtracks to the last '*' only, which is enough since a later '*' absorbs any earlier choice */
+    while (2 == result)
+    {
+        if ('*' == *pattern)
+        {
+            pattern++;
+            star = pattern;
+            resume = name;
+        }
+        else if ('\0' != *name && ('?' == *pattern || toupper((unsigned char)*pattern) == toupper((unsigned char)*name)))
+        {
+            pattern++;
+            name++;
+        }
+        else if ('\0' == *name && '\0' == *pattern)
+        {
+            result = 1;
+        }
+        else if (NULL != star && '\0' != *resume)
+        {
+            resume++;
+            pattern = star;
+            name = resume;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ *@brief Check an entry against the predicates of a search.
+ *@param query - The predicates.
+ *@param entry - The directory entry.
+ *@param name - The 8.3 name of the entry formatted as "NAME.EXT".
+ *@returns Returns 1 if the entry matches, 0 otherwise.
+ */
+static uint8_t find_match_entry(const fatfs_find_query_struct_t *query, const fatfs_directory_entry_list_struct_t *entry, const char *name)
+{
+    /* The cheap predicates are checked before the pattern */
+    return (query->Attributes_set == (entry->Attributes & query->Attributes_set) && 0 == (entry->Attributes & query->Attributes_clear) &&
+            entry->File_Size_in_bytes >= query->Minimum_size && (0 == query->Maximum_size || entry->File_Size_in_bytes <= query->Maximum_size) &&
+            (0 == query->Modified_after || entry->Last_Write_Date >= query->Modified_after) &&
+            (0 == query->Modified_before || entry->Last_Write_Date <= query->Modified_before) &&
+            (NULL == query->Pattern || 0 != find_match_pattern(query->Pattern, name) ||
+             (NULL != entry->Long_name && 0 != find_match_pattern(query->Pattern, entry->Long_name))))
+               ? 1
+               : 0;
+}
+
+/*
+ *@brief Open a directory for the walk of fatfs_find.
+ *@param frame - Receives the open directory.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param path_length - The length of the path of the directory.
+ *@returns No return value.
+ */
+static void find_open_directory(fatfs_find_frame_struct_t *frame, uint32_t first_cluster, uint32_t path_length)
+{
+    uint32_t node = tree_index_find_directory(first_cluster);
+    /* The node of the directory in the tree index plus one, 0 if there is none */
+
+    frame->Path_length = path_length;
+    frame->Iterator = NULL;
+    frame->Next_child = 0;
+    frame->Last_child = 0;
+
+    if (0 != node)
+    {
+        frame->Next_child = s_tree_nodes[node - 1].First_child;
+        frame->Last_child = s_tree_nodes[node - 1].First_child + s_tree_nodes[node - 1].Child_count;
+    }
+    else
+    {
+        frame->Iterator = fatfs_opendir(first_cluster);
+    }
+}
+
+/*
+ *@brief Get the next entry of a directory open for the walk of fatfs_find.
+ *@param frame - The open directory.
+ *@returns Returns the next entry, or NULL when the directory has no more entries.
+ */
+static const fatfs_directory_entry_list_struct_t *find_next_entry(fatfs_find_frame_struct_t *frame)
+{
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The next entry */
+
+    if (NULL != frame->Iterator)
+    {
+        entry = fatfs_readdir(frame->Iterator);
+    }
+    else if (frame->Next_child < frame->Last_child)
+    {
+        entry = &s_tree_nodes[frame->Next_child].Entry;
+        frame->Next_child++;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return entry;
+}
+
+/*
+ *@brief Mark the clusters of a directory chain in the directory bitmap of the deleted entry scan.
+ *@param scan - The state of the scan.
+ *@param cluster - The first cluster of the chain.
+ *@returns No return value.
+ */
+static void recovery_mark_directory(fatfs_recovery_scan_struct_t *scan, uint32_t cluster)
+{
+    /* End-of-chain markers are above the last cluster, and stopping at a marked cluster also stops on a loop */
+    while (2 <= cluster && s_FAT12Infor.Cluster_count + 2 > cluster && 0 == (scan->Directories[cluster / 8] & (1U << (cluster % 8))))
+    {
+        scan->Directories[cluster / 8] |= (uint8_t)(1U << (cluster % 8));
+        cluster = get_fat_entry(cluster);
+    }
+}
+
+/*
+ *@brief Estimate how much of the data of a deleted entry can be recovered.
+ *@param report - The report of the entry, whose recoverability fields are filled in.
+ *@returns No return value.
+ */
+static void recovery_estimate(fatfs_deleted_entry_struct_t *report)
+{
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    uint64_t needed = (0 != ((report->Entry.Attributes >> 4) & 1)) ? 1 : (report->Entry.File_Size_in_bytes + Cluster_size - 1) / Cluster_size;
+    /* The number of clusters of the data */
+    uint32_t first = report->Entry.First_Logical_Cluster;
+    /* The first cluster of the data */
+
+    report->Clusters_needed = (needed > s_FAT12Infor.Cluster_count) ? s_FAT12Infor.Cluster_count : (uint32_t)needed;
+    report->Clusters_free = 0;
+
+    if (0 == needed)
+    {
+        report->Recoverability = FATFS_RECOVERY_EMPTY;
+    }
+    else if (2 > first || s_FAT12Infor.Cluster_count + 2 <= first || needed > s_FAT12Infor.Cluster_count)
+    {
+        report->Recoverability = FATFS_RECOVERY_LOST;
+    }
+    else
+    {
+        /* Count the free clusters from the first one on, as the data is assumed to be contiguous */
+        while (report->Clusters_free < report->Clusters_needed && s_FAT12Infor.Cluster_count + 2 > first + report->Clusters_free &&
+               0 == fatfs_is_cluster_allocated(first + report->Clusters_free))
+        {
+            report->Clusters_free++;
+        }
+
+        if (report->Clusters_free == report->Clusters_needed)
+        {
+            report->Recoverability = FATFS_RECOVERY_GOOD;
+        }
+        else if (0 != report->Clusters_free)
+        {
+            report->Recoverability = FATFS_RECOVERY_PARTIAL;
+        }
+        else
+        {
+            report->Recoverability = FATFS_RECOVERY_LOST;
+        }
+    }
+}
+
+/*
+ *@brief Report the deleted entries of a part of a directory, and mark the chains of its subdirectories.
+ *@param scan - The state of the scan.
+ *@param buff - The raw entries.
+ *@param entry_count - The number of entries in buff.
+ *@param directory_cluster - The cluster holding the entries, 0 for the fixed root directory region.
+ *@param first_index - The position of the first entry of buff in its cluster or in the root directory region.
+ *@param orphaned - Set when the cluster is a deleted directory, in which case every entry is reported.
+ *@returns Returns 1 if the end-of-directory marker was found, 0 otherwise.
+ */
+static uint8_t recovery_scan_entries(fatfs_recovery_scan_struct_t *scan, const uint8_t *buff, uint32_t entry_count, uint32_t directory_cluster,
+                                     uint32_t first_index, uint8_t orphaned)
+{
+    uint8_t end = 0;
+    /* Set when the end-of-directory marker is found */
+    fatfs_deleted_entry_struct_t report;
+    /* The report of a deleted entry */
+    const uint8_t *raw = NULL;
+    /* The entry being scanned */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    for (i = 0; i < entry_count && 0 == end; i++)
+    {
+        raw = &buff[i * FATFS_DIRECTORY_ENTRY_SIZE];
+
+        if (0 == raw[0])
+        {
+            end = 1;
+        }
+        /* Long file name entries and the "." and ".." entries are not reported */
+        else if (FATFS_LFN_ATTRIBUTE == raw[11] || '.' == raw[0])
+        {
+            /* Do nothing */
+        }
+        else if (FATFS_DELETED_ENTRY == raw[0] || 0 != orphaned)
+        {
+            (void)decode_directory_entry(raw, 0, &scan->Lfn);
+            memcpy(&report.Entry, &s_dirList, sizeof(fatfs_directory_entry_list_struct_t));
+            report.Directory_cluster = directory_cluster;
+            report.Entry_index = first_index + i;
+            report.Orphaned = orphaned;
+            recovery_estimate(&report);
+            scan->Found++;
+            scan->Callback(&report, scan->Context);
+        }
+        /* A live subdirectory: its clusters are scanned as a directory when the pass reaches them */
+        else if (0 != ((raw[11] >> 4) & 1))
+        {
+            (void)decode_directory_entry(raw, 0, &scan->Lfn);
+            recovery_mark_directory(scan, s_dirList.First_Logical_Cluster);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    return end;
+}
+
+/*
+ *@brief Scan one cluster of the data area if it belongs to a directory.
+ *@param scan - The state of the scan.
+ *@param cluster - The cluster number.
+ *@param buff - The content of the cluster.
+ *@returns No return value.
+ */
+static void recovery_scan_cluster(fatfs_recovery_scan_struct_t *scan, uint32_t cluster, const uint8_t *buff)
+{
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    uint32_t dot_cluster = 0;
+    /* The first cluster recorded in the "." entry */
+    uint16_t cluster_high = 0;
+    /* The high word of the first cluster, only meaningful on FAT32 */
+    uint8_t signature = 0;
+    /* Set when the cluster starts with the "." and ".." entries of a directory */
+    uint8_t orphaned = 0;
+    /* Set when the cluster is a deleted directory */
+
+    /* The "." entry of the first cluster of a directory points to the cluster itself */
+    memcpy(&dot_cluster, &buff[26], 2);
+    if (FATFS_TYPE_FAT32 == s_FAT12Infor.Fat_type)
+    {
+        memcpy(&cluster_high, &buff[20], 2);
+        dot_cluster |= (uint32_t)cluster_high << 16;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    signature = (0 == memcmp(&buff[0], ".          ", FATFS_NAME_KEY_LENGTH) && 0 != ((buff[11] >> 4) & 1) && cluster == dot_cluster &&
+                 0 == memcmp(&buff[FATFS_DIRECTORY_ENTRY_SIZE], "..         ", FATFS_NAME_KEY_LENGTH))
+                    ? 1
+                    : 0;
+
+    if (0 != signature || 0 != (scan->Directories[cluster / 8] & (1U << (cluster % 8))))
+    {
+        orphaned = (0 != signature && 0 == fatfs_is_cluster_allocated(cluster)) ? 1 : 0;
+
+        /* A directory found by its signature only is marked so that the rest of its chain is scanned too */
+        if (0 == orphaned)
+        {
+            recovery_mark_directory(scan, cluster);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        scan->Scanned[cluster / 8] |= (uint8_t)(1U << (cluster % 8));
+        (void)recovery_scan_entries(scan, buff, Cluster_size / FATFS_DIRECTORY_ENTRY_SIZE, cluster, 0, orphaned);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/*
+ *@brief Pack the sort key of a directory entry.
+ *@param entry - The directory entry.
+ *@param sort_key - The order of the entries.
+ *@param index - The position of the entry before sorting.
+ *@param key - Receives the packed key.
+ *@returns No return value.
+ */
+static void sort_make_key(const fatfs_directory_entry_list_struct_t *entry, FATFS_SORT_KEY sort_key, uint32_t index, fatfs_sort_key_struct_t *key)
+{
+    key->Primary = 0;
+    key->Name = 0;
+    key->Extension = 0;
+    key->Index = index;
+
+    /* The "." and ".." entries get the smallest keys, so they stay in front of the listing */
+    if (0 != is_dot_entry(entry))
+    {
+        key->Name = ('.' == entry->File_name[1]) ? 1 : 0;
+    }
+    else
+    {
+        key->Name = entry->Name_key.Name;
+        key->Extension = entry->Name_key.Extension;
+
+        switch (sort_key)
+        {
+        case FATFS_SORT_EXTENSION:
+        {
+            key->Primary = key->Extension;
+            key->Extension = 0;
+            break;
+        }
+        case FATFS_SORT_SIZE:
+        {
+            key->Primary = entry->File_Size_in_bytes;
+            break;
+        }
+        case FATFS_SORT_MODIFIED:
+        {
+            key->Primary = ((uint32_t)entry->Last_Write_Date << 16) | entry->Last_Write_Time;
+            break;
+        }
+        case FATFS_SORT_CREATED:
+        {
+            key->Primary = ((uint32_t)entry->Creation_Date << 16) | entry->Creation_Time;
+            break;
+        }
+        default:
+        {
+            /* Sorted by name only */
+            break;
+        }
+        }
+    }
+}
+
+/*
+ *@brief Get one byte of a packed sort key.
+ *@param key - The packed key.
+ *@param pass - The byte, 0 being the least significant byte of the extension.
+ *@returns Returns the byte.
+ */
+static uint32_t sort_key_byte(const fatfs_sort_key_struct_t *key, uint32_t pass)
+{
+    return (uint32_t)(((3 > pass) ? (key->Extension >> (8 * pass)) : (11 > pass) ? (key->Name >> (8 * (pass - 3))) : (key->Primary >> (8 * (pass - 11)))) & 0xFF);
+}
+
+/*
+ *@brief Compute the sorted order of directory entries with an LSD radix sort.
+ *@param entries - The entries to sort.
+ *@param count - The number of entries.
+ *@param sort_key - The order of the entries.
+ *@returns Returns an allocated array giving, for each position of the sorted order, the position of the entry before sorting,
+ *         or NULL if memory allocation failed. The caller frees it.
+ */
+static uint32_t *sort_entries(const fatfs_directory_entry_list_struct_t *const *entries, uint32_t count, FATFS_SORT_KEY sort_key)
+{
+    uint32_t *order = (uint32_t *)malloc(count * sizeof(uint32_t));
+    /* The sorted order */
+    fatfs_sort_key_struct_t *keys = (fatfs_sort_key_struct_t *)malloc(2 * count * sizeof(fatfs_sort_key_struct_t));
+    /* The packed keys, then room for the output of a pass */
+    uint32_t *counts = (uint32_t *)calloc(FATFS_SORT_KEY_BYTES * 256, sizeof(uint32_t));
+    /* The histogram of every byte of the keys */
+    fatfs_sort_key_struct_t *source = keys;
+    /* The keys in the order of the last pass */
+    fatfs_sort_key_struct_t *target = NULL;
+    /* The keys in the order of the current pass */
+    fatfs_sort_key_struct_t *swap = NULL;
+    /* Used to exchange source and target */
+    uint32_t *histogram = NULL;
+    /* The histogram of the current pass, turned into the next free position of each byte value */
+    uint32_t total = 0;
+    /* The number of keys with a smaller byte value */
+    uint32_t value = 0;
+    /* A byte of a key */
+    uint32_t pass = 0;
+    /* Loop counter over the bytes of the keys */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    if (NULL != order && NULL != keys && NULL != counts)
+    {
+        target = &keys[count];
+
+        /* Pack the keys and build the histograms of every pass in one pass over the entries */
+        for (i = 0; i < count; i++)
+        {
+            sort_make_key(entries[i], sort_key, i, &source[i]);
+            for (pass = 0; pass < FATFS_SORT_KEY_BYTES; pass++)
+            {
+                counts[pass * 256 + sort_key_byte(&source[i], pass)]++;
+            }
+        }
+
+        /* Stable counting sort on each byte, least significant first; a byte shared by every key leaves the order unchanged */
+        for (pass = 0; pass < FATFS_SORT_KEY_BYTES && 1 < count; pass++)
+        {
+            histogram = &counts[pass * 256];
+            if (count != histogram[sort_key_byte(&source[0], pass)])
+            {
+                total = 0;
+                for (value = 0; value < 256; value++)
+                {
+                    i = histogram[value];
+                    histogram[value] = total;
+                    total += i;
+                }
+                for (i = 0; i < count; i++)
+                {
+                    value = sort_key_byte(&source[i], pass);
+                    target[histogram[value]] = source[i];
+                    histogram[value]++;
+                }
+                swap = source;
+                source = target;
+                target = swap;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            order[i] = source[i].Index;
+        }
+    }
+    else
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+        free(order);
+        order = NULL;
+    }
+
+    free(keys);
+    free(counts);
+
+    return order;
+}
+
+/*
+ *@brief Count the clusters allocated to a file or directory.
+ *@param first_cluster - The first cluster of the file or directory.
+ *@returns Returns the number of clusters, 0 for an empty file.
+ */
+static uint32_t du_count_clusters(uint32_t first_cluster)
+{
+    uint32_t count = 0;
+    /* The number of clusters */
+    uint32_t cluster = first_cluster;
+    /* The cluster being counted */
+    fatfs_exfat_stream_struct_t *stream = NULL;
+    /* The exFAT stream of the file, which records the length of a NoFatChain stream */
+
+    if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+    {
+        stream = exfat_find_stream(first_cluster);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (NULL != stream && 0 != stream->Cluster_count)
+    {
+        count = stream->Cluster_count;
+    }
+    else
+    {
+        /* Follow the chain like the chain walkers, without storing it */
+        while (2 <= cluster && s_fat_bad_cluster[s_FAT12Infor.Fat_type] > cluster && s_FAT12Infor.Cluster_count + 2 > cluster && s_FAT12Infor.Cluster_count > count)
+        {
+            count++;
+            cluster = get_fat_entry(cluster);
+        }
+    }
+
+    return count;
+}
+
+/*
+ *@brief Find the remembered disk usage of a directory.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@returns Returns the remembered totals, or NULL if the directory has not been computed since the last change.
+ */
+static const fatfs_du_memo_struct_t *du_memo_find(uint32_t first_cluster)
+{
+    const fatfs_du_memo_struct_t *memo = NULL;
+    /* The remembered totals */
+    uint32_t probe = 0;
+    /* The slot being probed */
+
+    /* Totals computed before a change may be wrong, so the table is emptied */
+    if (s_du_memo_generation != s_generation && 0 != s_du_memo_count)
+    {
+        memset(s_du_memo, 0, s_du_memo_capacity * sizeof(fatfs_du_memo_struct_t));
+        s_du_memo_count = 0;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    s_du_memo_generation = s_generation;
+
+    if (0 != s_du_memo_count)
+    {
+        probe = (first_cluster * 2654435761U) & (s_du_memo_capacity - 1);
+        while (0 != s_du_memo[probe].Key && NULL == memo)
+        {
+            if (first_cluster + 1 == s_du_memo[probe].Key)
+            {
+                memo = &s_du_memo[probe];
+            }
+            else
+            {
+                probe = (probe + 1) & (s_du_memo_capacity - 1);
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return memo;
+}
+
+/*
+ *@brief Remember the disk usage of a directory.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param usage - The totals of the directory.
+ *@returns Returns 1 if the totals were stored, 0 if memory allocation failed.
+ */
+static uint8_t du_memo_store(uint32_t first_cluster, const fatfs_disk_usage_struct_t *usage)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (stored) */
+    fatfs_du_memo_struct_t *old_memo = s_du_memo;
+    /* The table before it is grown */
+    uint32_t old_capacity = s_du_memo_capacity;
+    /* The number of slots before the table is grown */
+    uint32_t probe = 0;
+    /* The slot being probed */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Grow the table to keep it at most half full, rehashing the directories already stored */
+    if (2 * (s_du_memo_count + 1) > s_du_memo_capacity)
+    {
+        s_du_memo_capacity = (0 == old_capacity) ? 64 : old_capacity * 2;
+        s_du_memo = (fatfs_du_memo_struct_t *)calloc(s_du_memo_capacity, sizeof(fatfs_du_memo_struct_t));
+
+        if (NULL != s_du_memo)
+        {
+            for (i = 0; i < old_capacity; i++)
+            {
+                if (0 != old_memo[i].Key)
+                {
+                    probe = ((old_memo[i].Key - 1) * 2654435761U) & (s_du_memo_capacity - 1);
+                    while (0 != s_du_memo[probe].Key)
+                    {
+                        probe = (probe + 1) & (s_du_memo_capacity - 1);
+                    }
+                    s_du_memo[probe] = old_memo[i];
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            free(old_memo);
+        }
+        else
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            s_du_memo = old_memo;
+            s_du_memo_capacity = old_capacity;
+            result = 0;
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (0 != result)
+    {
+        probe = (first_cluster * 2654435761U) & (s_du_memo_capacity - 1);
+        while (0 != s_du_memo[probe].Key && first_cluster + 1 != s_du_memo[probe].Key)
+        {
+            probe = (probe + 1) & (s_du_memo_capacity - 1);
+        }
+        if (0 == s_du_memo[probe].Key)
+        {
+            s_du_memo_count++;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        s_du_memo[probe].Key = first_cluster + 1;
+        s_du_memo[probe].Usage = *usage;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Open a directory for the walk of fatfs_disk_usage.
+ *@param frame - The frame receiving the directory.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@returns No return value.
+ */
+static void du_open_directory(fatfs_du_frame_struct_t *frame, uint32_t first_cluster)
+{
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+
+    find_open_directory(&frame->Walk, first_cluster, 0);
+    frame->Cluster = first_cluster;
+    memset(&frame->Usage, 0, sizeof(fatfs_disk_usage_struct_t));
+
+    /* The directory itself uses its clusters, or the fixed root directory region on FAT12 and FAT16 */
+    if (0 != first_cluster)
+    {
+        frame->Usage.Allocated_size = (uint64_t)du_count_clusters(first_cluster) * Cluster_size;
+    }
+    else if (0 != num_cluster_in_root_directory)
+    {
+        frame->Usage.Allocated_size = (uint64_t)num_cluster_in_root_directory * s_FAT12Infor.bytes_per_sector;
+    }
+    else
+    {
+        frame->Usage.Allocated_size = (uint64_t)du_count_clusters(s_FAT12Infor.Root_cluster) * Cluster_size;
+    }
+}
+
+/*
+ *@brief Add the totals of a subdirectory to the totals of its directory.
+ *@param usage - The totals of the directory.
+ *@param child - The totals of the subdirectory.
+ *@returns No return value.
+ */
+static void du_add_directory(fatfs_disk_usage_struct_t *usage, const fatfs_disk_usage_struct_t *child)
+{
+    usage->Logical_size += child->Logical_size;
+    usage->Allocated_size += child->Allocated_size;
+    usage->File_count += child->File_count;
+    usage->Directory_count += child->Directory_count + 1;
+}
+
+/*
+ *@brief Release the entries and fingerprints of a directory.
+ *@param slot - The slot of the directory.
+ *@returns No return value.
+ */
+static void dir_fingerprint_release(fatfs_dir_fingerprint_struct_t *slot)
+{
+    deallocate_Dir_Array(slot->Listing);
+    free(slot->Clusters);
+    memset(slot, 0, sizeof(fatfs_dir_fingerprint_struct_t));
+}
+
+/*
+ *@brief Find the fingerprints of a directory read before.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@returns Returns the slot of the directory, or NULL if it is not kept.
+ */
+static const fatfs_dir_fingerprint_struct_t *dir_fingerprint_find(uint32_t first_cluster)
+{
+    fatfs_dir_fingerprint_struct_t *slot = NULL;
+    /* The slot holding the directory */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    s_dir_fingerprint_clock++;
+
+    for (i = 0; i < FATFS_FINGERPRINT_SLOTS && NULL == slot; i++)
+    {
+        if (NULL != s_dir_fingerprints[i].Listing && s_dir_fingerprints[i].First_cluster == first_cluster)
+        {
+            slot = &s_dir_fingerprints[i];
+            slot->Last_used = s_dir_fingerprint_clock;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    return slot;
+}
+
+/*
+ *@brief Keep the entries of a directory with the fingerprints of its clusters, replacing the least recently used directory.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param array - The entries of the directory, copied.
+ *@param clusters - The fingerprints of the clusters, owned by the slot from now on.
+ *@param cluster_count - The number of fingerprints.
+ *@returns No return value.
+ */
+static void dir_fingerprint_store(uint32_t first_cluster, const DirArray *array, fatfs_cluster_fingerprint_struct_t *clusters, uint32_t cluster_count)
+{
+    fatfs_dir_fingerprint_struct_t *victim = &s_dir_fingerprints[0];
+    /* The slot receiving the directory */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* The previous fingerprints of the directory are replaced, otherwise the least recently used ones */
+    for (i = 0; i < FATFS_FINGERPRINT_SLOTS; i++)
+    {
+        if (NULL != s_dir_fingerprints[i].Listing && s_dir_fingerprints[i].First_cluster == first_cluster)
+        {
+            victim = &s_dir_fingerprints[i];
+            i = FATFS_FINGERPRINT_SLOTS;
+        }
+        else if (s_dir_fingerprints[i].Last_used < victim->Last_used)
+        {
+            victim = &s_dir_fingerprints[i];
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    dir_fingerprint_release(victim);
+    victim->Listing = (DirArray *)malloc(sizeof(DirArray) + array->capacity * sizeof(fatfs_directory_entry_list_struct_t));
+
+    /* Check if memory allocation was successful */
+    if (NULL != victim->Listing)
+    {
+        victim->Listing->count = 0;
+        victim->Listing->capacity = array->capacity;
+        victim->Listing->names = NULL;
+        for (i = 0; i < array->count; i++)
+        {
+            append_directory_entry(&victim->Listing, &array->entries[i]);
+        }
+        victim->First_cluster = first_cluster;
+        victim->Last_used = s_dir_fingerprint_clock;
+        victim->Cluster_count = cluster_count;
+        victim->Clusters = clusters;
+    }
+    else
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+        free(clusters);
+    }
+}
+
+/*
+ *@brief Read a FAT directory into an array, copying the entries of the clusters that are unchanged since it was last read.
+ *@param array - The array receiving the entries.
+ *@param first_cluster - The first cluster of the directory, 0 for the root directory.
+ *@param reuse - 0 to decode every cluster, 1 to copy the entries of unchanged clusters.
+ *@returns Returns 1 if the directory was read, 0 if it must be read again with reuse set to 0 because a long file name
+ *         starts in a copied cluster and ends in a changed one.
+ */
+static uint8_t dir_read_fingerprinted(DirArray **array, uint32_t first_cluster, uint8_t reuse)
+{
+    uint8_t result = 1;
+    /* Default result is the directory was read */
+    DirIterator *iterator = fatfs_opendir(first_cluster);
+    /* The iterator reading the clusters of the directory */
+    const fatfs_dir_fingerprint_struct_t *previous = (0 != reuse) ? dir_fingerprint_find(first_cluster) : NULL;
+    /* The fingerprints of the last read of the directory, NULL if there are none */
+    fatfs_cluster_fingerprint_struct_t *clusters = NULL;
+    /* The fingerprints of the clusters read now */
+    fatfs_cluster_fingerprint_struct_t *grown = NULL;
+    /* The fingerprints after they have grown */
+    uint32_t capacity = 0;
+    /* The number of fingerprints allocated */
+    uint32_t count = 0;
+    /* The number of clusters read */
+    uint32_t matched = 0;
+    /* The number of leading clusters that hash as in the last read */
+    uint8_t status = FATFS_DECODE_SKIP;
+    /* The result of decoding an entry */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    while (NULL != iterator && 0 == iterator->end_of_directory && 1 == result)
+    {
+        dir_iterator_load(iterator);
+
+        /* Make room for the fingerprint of the cluster */
+        if (0 != iterator->buffer_length && count == capacity)
+        {
+            capacity = (0 == capacity) ? FATFS_FINGERPRINT_INITIAL_CLUSTERS : 2 * capacity;
+            grown = (fatfs_cluster_fingerprint_struct_t *)realloc(clusters, capacity * sizeof(fatfs_cluster_fingerprint_struct_t));
+            if (NULL != grown)
+            {
+                clusters = grown;
+            }
+            else
+            {
+                /* If memory allocation failed, call the error callback and keep the entries read so far */
+                error_callback(DYNAMIC_ALLOCATON_ERROR);
+                iterator->end_of_directory = 1;
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (0 == iterator->end_of_directory)
+        {
+            clusters[count].Hash = snapshot_hash(FATFS_SNAPSHOT_HASH_BASIS, iterator->buffer, iterator->buffer_length);
+
+            /* The cluster is unchanged and so are the ones before it: copy its entries */
+            if (NULL != previous && matched == count && count < previous->Cluster_count && previous->Clusters[count].Hash == clusters[count].Hash)
+            {
+                for (i = (0 == count) ? 0 : previous->Clusters[count - 1].Entry_end; i < previous->Clusters[count].Entry_end; i++)
+                {
+                    append_directory_entry(array, &previous->Listing->entries[i]);
+                }
+                clusters[count].Flags = previous->Clusters[count].Flags;
+                iterator->end_of_directory = (0 != (clusters[count].Flags & FATFS_FINGERPRINT_END)) ? 1 : 0;
+                matched++;
+            }
+            /* The decoder has not seen the start of a long file name left pending by the copied clusters */
+            else if (0 != matched && matched == count && 0 != (clusters[count - 1].Flags & FATFS_FINGERPRINT_LFN_ACTIVE))
+            {
+                result = 0;
+            }
+            else
+            {
+                /* Decode every entry of the cluster, up to the end-of-directory marker */
+                status = FATFS_DECODE_SKIP;
+                while (FATFS_DECODE_END != status &&
+                       (iterator->position < iterator->buffer_length || 0 != (iterator->scan.Short | iterator->scan.Lfn | iterator->scan.End)))
+                {
+                    status = dir_iterator_scan(iterator, 1);
+                    if (FATFS_DECODE_ENTRY == status)
+                    {
+                        append_directory_entry(array, &s_dirList);
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+                }
+                clusters[count].Flags = ((0 != iterator->lfn.Active) ? FATFS_FINGERPRINT_LFN_ACTIVE : 0) | ((FATFS_DECODE_END == status) ? FATFS_FINGERPRINT_END : 0);
+                iterator->end_of_directory = (FATFS_DECODE_END == status) ? 1 : 0;
+            }
+
+            clusters[count].Entry_end = (*array)->count;
+            count++;
+        }
+        else
+        {
+            /* Do nothing, nothing was read */
+        }
+    }
+
+    /* Keep the fingerprints unless the directory is exactly as it was */
+    if (1 == result && NULL != iterator && (NULL == previous || matched != count || count != previous->Cluster_count))
+    {
+        dir_fingerprint_store(first_cluster, *array, clusters, count);
+        clusters = NULL;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    free(clusters);
+    fatfs_closedir(iterator);
+
+    return result;
+}
+
+/*
+ *@brief Read a directory from the FAT file system into one contiguous array.
+ *@param First_Logical_Directory_of_current - The first logical directory of the current directory.
+ *@returns Returns the directory array, or NULL if memory allocation failed.
+ */
+DirArray *fatfs_read_dir_array(uint32_t First_Logical_Directory_of_current)
+{
+    DirArray *array = NULL;
+    /* The directory array returned to the caller */
+    DirIterator *iterator = NULL;
+    /* The iterator decoding the directory */
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The entry being appended */
+
+    uint32_t node = tree_index_find_directory(First_Logical_Directory_of_current);
+    /* The node of the directory in the tree index plus one, 0 if there is none */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Allocate the array with room for a small directory, it grows while the entries are decoded */
+    array = (DirArray *)malloc(sizeof(DirArray) + FATFS_DIR_ARRAY_INITIAL_CAPACITY * sizeof(fatfs_directory_entry_list_struct_t));
+
+    /* Check if memory allocation was successful */
+    if (NULL == array)
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+    /* A directory of the tree index is listed from memory */
+    else if (0 != node)
+    {
+        array->count = 0;
+        array->capacity = FATFS_DIR_ARRAY_INITIAL_CAPACITY;
+        array->names = NULL;
+        for (i = 0; i < s_tree_nodes[node - 1].Child_count; i++)
+        {
+            append_directory_entry(&array, &s_tree_nodes[s_tree_nodes[node - 1].First_child + i].Entry);
+        }
+    }
+    /* A FAT directory is decoded only where its clusters changed since it was last read */
+    else if (FATFS_TYPE_EXFAT != s_FAT12Infor.Fat_type)
+    {
+        array->count = 0;
+        array->capacity = FATFS_DIR_ARRAY_INITIAL_CAPACITY;
+        array->names = NULL;
+
+        if (0 == dir_read_fingerprinted(&array, First_Logical_Directory_of_current, 1))
+        {
+            /* Start over, decoding every cluster */
+            name_arena_release(array->names);
+            array->count = 0;
+            array->names = NULL;
+            dir_read_fingerprinted(&array, First_Logical_Directory_of_current, 0);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    /* exFAT directories register the streams of their files while they are decoded, so they are always decoded */
+    else
+    {
+        array->count = 0;
+        array->capacity = FATFS_DIR_ARRAY_INITIAL_CAPACITY;
+        array->names = NULL;
+
+        /* Append every entry of the directory */
+        iterator = fatfs_opendir(First_Logical_Directory_of_current);
+        entry = fatfs_readdir(iterator);
+        while (NULL != entry)
+        {
+            append_directory_entry(&array, entry);
+            entry = fatfs_readdir(iterator);
+        }
+        fatfs_closedir(iterator);
+    }
+
+    return array;
+}
+
+/*
+ *@brief Set a cursor to the start of a directory.
+ *@param cursor - The cursor.
+ *@param First_Logical_Directory_of_current - The first logical directory of the directory, 0 for the root directory.
+ *@returns No return value.
+ */
+void fatfs_dir_cursor_init(fatfs_dir_cursor_struct_t *cursor, uint32_t First_Logical_Directory_of_current)
+{
+    memset(cursor, 0, sizeof(fatfs_dir_cursor_struct_t));
+    cursor->Directory = First_Logical_Directory_of_current;
+}
+
+/*
+ *@brief Read the next page of a directory.
+ *@param cursor - The cursor, moved past the entries read.
+ *@param page_size - The largest number of entries to read.
+ *@returns Returns the entries of the page, or NULL if memory allocation failed.
+ */
+DirArray *fatfs_read_dir_page(fatfs_dir_cursor_struct_t *cursor, uint32_t page_size)
+{
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    DirArray *array = NULL;
+    /* The entries of the page */
+    DirIterator *iterator = NULL;
+    /* The iterator reading the directory */
+    uint32_t node = tree_index_find_directory(cursor->Directory);
+    /* The node of the directory in the tree index plus one, 0 if there is none */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* The array is allocated for a whole page, so it never grows */
+    array = (DirArray *)malloc(sizeof(DirArray) + ((0 != page_size) ? page_size : 1) * sizeof(fatfs_directory_entry_list_struct_t));
+
+    /* Check if memory allocation was successful */
+    if (NULL == array)
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+    else
+    {
+        array->count = 0;
+        array->capacity = (0 != page_size) ? page_size : 1;
+        array->names = NULL;
+    }
+
+    if (NULL == array || 0 != cursor->End)
+    {
+        /* Do nothing */
+    }
+    /* A directory of the tree index is paged from memory, by the number of entries already returned */
+    else if (0 != node)
+    {
+        for (i = cursor->Returned; i < s_tree_nodes[node - 1].Child_count && array->count < page_size; i++)
+        {
+            append_directory_entry(&array, &s_tree_nodes[s_tree_nodes[node - 1].First_child + i].Entry);
+        }
+        cursor->End = (i >= s_tree_nodes[node - 1].Child_count) ? 1 : 0;
+    }
+    else
+    {
+        /* Resume where the last page stopped, reading only the clusters from there on */
+        iterator = fatfs_opendir(cursor->Directory);
+        if (NULL != iterator && 0 != cursor->Returned)
+        {
+            iterator->dot_dot_pending = 0;
+            dir_iterator_seek(iterator, cursor->Cluster, cursor->Entry);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        while (NULL != iterator && array->count < page_size && 0 == cursor->End)
+        {
+            /* The synthesized exFAT ".." entry comes first and does not move the cursor */
+            if (0 != iterator->dot_dot_pending)
+            {
+                iterator->dot_dot_pending = 0;
+                append_directory_entry(&array, &iterator->entry);
+            }
+            else if (FATFS_DECODE_ENTRY == dir_iterator_next(iterator, 1))
+            {
+                append_directory_entry(&array, &s_dirList);
+                cursor->Cluster = iterator->loaded_count - 1 + iterator->next_offset / Cluster_size;
+                cursor->Entry = (iterator->next_offset % Cluster_size) / FATFS_DIRECTORY_ENTRY_SIZE;
+            }
+            else
+            {
+                cursor->End = 1;
+            }
+        }
+        fatfs_closedir(iterator);
+    }
+
+    if (NULL != array)
+    {
+        cursor->Returned += array->count;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return array;
+}
+
+/*
+ *@brief Allocate directory columns with no entry.
+ *@param capacity - The number of rows of every column.
+ *@returns Returns the columns, or NULL if memory allocation failed.
+ */
+static fatfs_dir_columns_struct_t *dir_columns_allocate(uint32_t capacity)
+{
+    fatfs_dir_columns_struct_t *columns = NULL;
+    /* The columns returned */
+
+    /* The columns follow the structure from the widest to the narrowest type, so every column is aligned */
+    columns = (fatfs_dir_columns_struct_t *)malloc(sizeof(fatfs_dir_columns_struct_t) +
+                                                   (size_t)capacity * (sizeof(uint64_t) + sizeof(fatfs_name_key_struct_t) + sizeof(uint32_t) + 2 * sizeof(uint16_t) + sizeof(uint8_t)));
+
+    /* Check if memory allocation was successful */
+    if (NULL != columns)
+    {
+        columns->Count = 0;
+        columns->Capacity = capacity;
+        columns->Sizes = (uint64_t *)(columns + 1);
+        columns->Name_keys = (fatfs_name_key_struct_t *)(columns->Sizes + capacity);
+        columns->First_clusters = (uint32_t *)(columns->Name_keys + capacity);
+        columns->Modified_dates = (uint16_t *)(columns->First_clusters + capacity);
+        columns->Created_dates = columns->Modified_dates + capacity;
+        columns->Attributes = (uint8_t *)(columns->Created_dates + capacity);
+    }
+    else
+    {
+        /* If memory allocation failed, call the error callback with the appropriate error code */
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+
+    return columns;
+}
+
+/*
+ *@brief Append an entry to directory columns, doubling their capacity when they are full.
+ *@param columns - The columns, replaced when they grow.
+ *@param view - The view of the entry.
+ *@returns No return value.
+ */
+static void dir_columns_append(fatfs_dir_columns_struct_t **columns, const fatfs_entry_view_struct_t *view)
+{
+    fatfs_dir_columns_struct_t *grown = NULL;
+    /* The columns after they have grown */
+    uint32_t row = (*columns)->Count;
+    /* The row of the entry */
+
+    /* Every column moves when the capacity changes, so they are copied one by one */
+    if (row == (*columns)->Capacity)
+    {
+        grown = dir_columns_allocate(2 * (*columns)->Capacity);
+        if (NULL != grown)
+        {
+            grown->Count = row;
+            memcpy(grown->Sizes, (*columns)->Sizes, row * sizeof(uint64_t));
+            memcpy(grown->Name_keys, (*columns)->Name_keys, row * sizeof(fatfs_name_key_struct_t));
+            memcpy(grown->First_clusters, (*columns)->First_clusters, row * sizeof(uint32_t));
+            memcpy(grown->Modified_dates, (*columns)->Modified_dates, row * sizeof(uint16_t));
+            memcpy(grown->Created_dates, (*columns)->Created_dates, row * sizeof(uint16_t));
+            memcpy(grown->Attributes, (*columns)->Attributes, row * sizeof(uint8_t));
+            free(*columns);
+            *columns = grown;
+        }
+        else
+        {
+            /* Do nothing, the error callback has already been called */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Check if there is room for the entry */
+    if (row < (*columns)->Capacity)
+    {
+        if (NULL != view->Raw)
+        {
+            make_name_key((const char *)view->Raw, (const char *)&view->Raw[8], &(*columns)->Name_keys[row]);
+            memcpy(&(*columns)->Modified_dates[row], &view->Raw[24], 2);
+            memcpy(&(*columns)->Created_dates[row], &view->Raw[16], 2);
+        }
+        else
+        {
+            (*columns)->Name_keys[row] = view->Entry->Name_key;
+            (*columns)->Modified_dates[row] = view->Entry->Last_Write_Date;
+            (*columns)->Created_dates[row] = view->Entry->Creation_Date;
+        }
+        (*columns)->Sizes[row] = fatfs_view_size(view);
+        (*columns)->First_clusters[row] = fatfs_view_first_cluster(view);
+        (*columns)->Attributes[row] = fatfs_view_attributes(view);
+        (*columns)->Count++;
+    }
+    else
+    {
+        /* Do nothing, the error callback has already been called */
+    }
+}
+
+/*
+ *@brief Read a directory into columns.
+ *@param First_Logical_Directory_of_current - The first logical directory of the directory, 0 for the root directory.
+ *@returns Returns the columns, or NULL if memory allocation failed.
+ */
+fatfs_dir_columns_struct_t *fatfs_read_dir_columns(uint32_t First_Logical_Directory_of_current)
+{
+    fatfs_dir_columns_struct_t *columns = dir_columns_allocate(FATFS_DIR_ARRAY_INITIAL_CAPACITY);
+    /* The columns returned to the caller */
+    DirIterator *iterator = NULL;
+    /* The iterator reading the directory */
+    const fatfs_entry_view_struct_t *view = NULL;
+    /* The entry being appended */
+    fatfs_entry_view_struct_t node_view;
+    /* The view of an entry of the tree index */
+    uint32_t node = tree_index_find_directory(First_Logical_Directory_of_current);
+    /* The node of the directory in the tree index plus one, 0 if there is none */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    if (NULL == columns)
+    {
+        /* Do nothing, the error callback has already been called */
+    }
+    /* A directory of the tree index is read from memory */
+    else if (0 != node)
+    {
+        node_view.Raw = NULL;
+        node_view.Long_name = NULL;
+        for (i = 0; i < s_tree_nodes[node - 1].Child_count; i++)
+        {
+            node_view.Entry = &s_tree_nodes[s_tree_nodes[node - 1].First_child + i].Entry;
+            dir_columns_append(&columns, &node_view);
+        }
+    }
+    else
+    {
+        /* Only the fields stored in the columns are decoded */
+        iterator = fatfs_opendir(First_Logical_Directory_of_current);
+        view = fatfs_readdir_view(iterator);
+        while (NULL != view)
+        {
+            dir_columns_append(&columns, view);
+            view = fatfs_readdir_view(iterator);
+        }
+        fatfs_closedir(iterator);
+    }
+
+    return columns;
+}
+
+/*
+ *@brief Select the rows of a set of columns matching a query.
+ *@param columns - The columns, or NULL.
+ *@param query - The predicates.
+ *@param rows - Receives the matching rows.
+ *@returns Returns the number of matching rows.
+ */
+uint32_t fatfs_select_dir_columns(const fatfs_dir_columns_struct_t *columns, const fatfs_find_query_struct_t *query, uint32_t *rows)
+{
+    uint32_t count = 0;
+    /* The number of rows selected so far */
+    uint32_t kept = 0;
+    /* The number of selected rows kept by the predicate being tested */
+    uint32_t row = 0;
+    /* The row being tested */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    if (NULL != columns && NULL != query)
+    {
+        /* The attribute column is scanned whole; every row is written and kept only if it matches */
+        for (i = 0; i < columns->Count; i++)
+        {
+            rows[count] = i;
+            count += (query->Attributes_set == (columns->Attributes[i] & query->Attributes_set) && 0 == (columns->Attributes[i] & query->Attributes_clear)) ? 1 : 0;
+        }
+
+        /* Every other predicate narrows the selection down in place */
+        if (0 != query->Minimum_size || 0 != query->Maximum_size)
+        {
+            kept = 0;
+            for (i = 0; i < count; i++)
+            {
+                row = rows[i];
+                rows[kept] = row;
+                kept += (columns->Sizes[row] >= query->Minimum_size && (0 == query->Maximum_size || columns->Sizes[row] <= query->Maximum_size)) ? 1 : 0;
+            }
+            count = kept;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (0 != query->Modified_after || 0 != query->Modified_before)
+        {
+            kept = 0;
+            for (i = 0; i < count; i++)
+            {
+                row = rows[i];
+                rows[kept] = row;
+                kept += (columns->Modified_dates[row] >= query->Modified_after && (0 == query->Modified_before || columns->Modified_dates[row] <= query->Modified_before)) ? 1 : 0;
+            }
+            count = kept;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return count;
+}
+
+/*
+ *@brief Sort a directory array.
+ *@param array - The directory array, or NULL.
+ *@param key - The order of the entries.
+ *@returns No return value.
+ */
+void fatfs_sort_dir_array(DirArray *array, FATFS_SORT_KEY key)
+{
+    const fatfs_directory_entry_list_struct_t **entries = NULL;
+    /* The entries to sort */
+    uint32_t *order = NULL;
+    /* The sorted order */
+    fatfs_directory_entry_list_struct_t moved;
+    /* The entry taken out of the array while a cycle of the permutation is applied */
+    uint32_t i = 0;
+    /* Loop counter */
+    uint32_t j = 0;
+    /* The position being filled */
+    uint32_t k = 0;
+    /* The position the entry of j comes from */
+
+    if (NULL != array && 1 < array->count)
+    {
+        entries = (const fatfs_directory_entry_list_struct_t **)malloc(array->count * sizeof(fatfs_directory_entry_list_struct_t *));
+        if (NULL != entries)
+        {
+            for (i = 0; i < array->count; i++)
+            {
+                entries[i] = &array->entries[i];
+            }
+            order = sort_entries(entries, array->count, key);
+        }
+        else
+        {
+            /* If memory allocation failed, call the error callback with the appropriate error code */
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+
+        /* Apply the permutation in place, one cycle at a time; a position is marked done by pointing to itself */
+        for (i = 0; NULL != order && i < array->count; i++)
+        {
+            if (order[i] != i)
+            {
+                memcpy(&moved, &array->entries[i], sizeof(fatfs_directory_entry_list_struct_t));
+                j = i;
+                while (order[j] != i)
+                {
+                    k = order[j];
+                    memcpy(&array->entries[j], &array->entries[k], sizeof(fatfs_directory_entry_list_struct_t));
+                    order[j] = j;
+                    j = k;
+                }
+                memcpy(&array->entries[j], &moved, sizeof(fatfs_directory_entry_list_struct_t));
+                order[j] = j;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+
+        free(order);
+        free(entries);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
+/*
+ *@brief Sort a directory list.
+ *@param head - The head of the directory list, or NULL.
+ *@param key - The order of the entries.
+ *@returns Returns the new head of the list.
+ */
+DirList *fatfs_sort_dir_list(DirList *head, FATFS_SORT_KEY key)
+{
+    DirList **nodes = NULL;
+    /* The nodes of the list */
+    const fatfs_directory_entry_list_struct_t **entries = NULL;
+    /* The entries of the nodes */
+    uint32_t *order = NULL;
+    /* The sorted order */
+    DirList *node = head;
+    /* The node being counted */
+    uint32_t count = 0;
+    /* The number of nodes */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    while (NULL != node)
+    {
+        count++;
+        node = node->next;
+    }
+
+    if (1 < count)
+    {
+        /* The node and entry pointers share one allocation */
+        nodes = (DirList **)malloc(count * (sizeof(DirList *) + sizeof(fatfs_directory_entry_list_struct_t *)));
+        if (NULL != nodes)
+        {
+            entries = (const fatfs_directory_entry_list_struct_t **)&nodes[count];
+            node = head;
+            for (i = 0; i < count; i++)
+            {
+                nodes[i] = node;
+                entries[i] = &node->data;
+                node = node->next;
+            }
+            order = sort_entries(entries, count, key);
+        }
+        else
+        {
+            /* If memory allocation failed, call the error callback with the appropriate error code */
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+        }
+
+        /* Link the nodes again in the sorted order */
+        if (NULL != order)
+        {
+            head = nodes[order[0]];
+            for (i = 0; i + 1 < count; i++)
+            {
+                nodes[order[i]]->next = nodes[order[i + 1]];
+            }
+            nodes[order[count - 1]]->next = NULL;
+        }
+        else
+        {
+            /* Do nothing, the list keeps its order */
+        }
+
+        free(order);
+        free(nodes);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return head;
+}
+
+/*
+ *@brief Read a directory from the FAT file system.
+ *@param First_Logical_Directory_of_current - The first logical directory of the current directory.
+ *@returns Returns a pointer to the head of the directory list.
+ */
+DirList *fatfs_read_dir(uint32_t First_Logical_Directory_of_current)
+{
+    DirArray *array = fatfs_read_dir_array(First_Logical_Directory_of_current);
+    /* The directory decoded into one array */
+    uint32_t i = 0;
+    /* Loop counter */
+    DirList *head = NULL;
+    /* the head of the directory list*/
+    DirList *tail = NULL;
+    /* the tail of the directory list */
+    DirList *newNode = NULL;
+    /* the new node of the directory list */
+    uint32_t name_size = 0;
+    /* The number of bytes of the long name of the entry, 0 if it has none */
+
+    /* Copy the array into a linked list for the callers that use one */
+    for (i = 0; NULL != array && i < array->count; i++)
+    {
+        /* The long name is stored behind the node so that it is released together with it */
+        name_size = (NULL != array->entries[i].Long_name) ? (uint32_t)strlen(array->entries[i].Long_name) + 1 : 0;
+        newNode = createNodeEntry(name_size);
+
+        /* Check if the node was created */
+        if (NULL != newNode)
+        {
+            memcpy(&newNode->data, &array->entries[i], sizeof(fatfs_directory_entry_list_struct_t));
+            if (0 != name_size)
+            {
+                memcpy(newNode + 1, array->entries[i].Long_name, name_size);
+                newNode->data.Long_name = (const char *)(newNode + 1);
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            /* If the directory list is empty, set the head and tail to the new node */
+            if (NULL == head)
+            {
+                head = newNode;
+                tail = newNode;
+            }
+            else
+            {
+                /* If the directory list is not empty, add the new node to the end of the list */
+                tail->next = newNode;
+                tail = newNode;
+            }
+        }
+        else
+        {
+            /* Stop, the error callback has already been called */
+            i = array->count;
+        }
+    }
+
+    deallocate_Dir_Array(array);
+
+    /* Return the head of the directory list */
+    return head;
+}
+
+/*
+ *@brief Read a file from the FAT file system.
+ *@param First_Logical_Cluster_of_current - The first logical cluster of the current file.
+ *@returns Returns a pointer to the head of the cluster list.
+ */
+ClusterList *fatfs_read_file(uint32_t First_Logical_Cluster_of_current)
+{
+    uint8_t *buff = NULL;
+    /* Buffer to store the data read from the file system */
+    uint32_t i = 0;
+    /* Loop counter */
+    uint32_t number_of_bytes_read = 0;
+    /* Variable to store the number of bytes read */
+    fatfs_extent_struct_t *extents = NULL;
+    /* The extents of the file */
+    uint32_t extent_count = 0;
+    /* The number of extents */
+    uint32_t extent_size = 0;
+    /* The size of the part of the current extent read into one node, in bytes */
+    uint32_t clusters_done = 0;
+    /* The number of clusters of the current extent already read */
+    uint32_t node_clusters = FATFS_READ_NODE_MAX_SIZE / (s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector);
+    /* The largest number of clusters read into one node */
+    uint32_t cluster_count = 0;
+    /* The number of clusters read into the current node */
+    ClusterList *head_cluster_list = NULL;
+    /* the head of the cluster list*/
+    ClusterList *tail_cluster_list = NULL;
+    /* the tail of the cluster list */
+    ClusterList *newNode = NULL;
+    /* the new node of the cluster list */
+
+    /* exFAT files are laid out by the exFAT reader, which may skip the FAT for contiguous files */
+    if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+    {
+        extents = exfat_get_file_extents(First_Logical_Cluster_of_current, &extent_count);
+    }
+    else
+    {
+        /* Get every extent of the file, from the chain cache when the file was read before */
+        extents = get_cluster_extents(First_Logical_Cluster_of_current, &extent_count);
+    }
+
+    /* Loop until the last extent is read, one node per extent, or per FATFS_READ_NODE_MAX_SIZE bytes of a larger extent */
+    while (i < extent_count)
+    {
+        cluster_count = extents[i].Cluster_count - clusters_done;
+        cluster_count = (cluster_count > node_clusters) ? node_clusters : cluster_count;
+        extent_size = cluster_count * s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+
+        /* Allocate memory for the buffer, buff will be freed when the linked list is deallocated,
+        specifically, it will be freed in the deallocate_Cluster_List function  */
+        buff = (uint8_t *)calloc(extent_size, sizeof(uint8_t));
+
+        /* Check if memory allocation was successful */
+        if (NULL != buff)
+        {
+            /* Read the part of the extent with one range read */
+            number_of_bytes_read = (uint32_t)kmc_read_multi_sector(get_cluster_offset(extents[i].First_cluster + clusters_done), cluster_count * s_FAT12Infor.sectors_per_cluster, buff);
+
+            /* Create a new cluster node if the correct number of bytes were read */
+            if (number_of_bytes_read == extent_size)
+            {
+                newNode = createNodeCluster();
+            }
+            else
+            {
+                newNode = NULL;
+            }
+
+            /* Check if the cluster was read and the node was created */
+            if (NULL != newNode)
+            {
+                /* Assign the data in the buffer to the new node */
+                newNode->data_in_cluster = buff;
+                newNode->number_of_bytes = number_of_bytes_read;
+
+                /* If the cluster list is empty, set the head and tail to the new node */
+                if (NULL == head_cluster_list)
+                {
+                    head_cluster_list = newNode;
+                    tail_cluster_list = newNode;
+                }
+                else
+                {
+                    /* If the cluster list is not empty, add the new node to the end of the list */
+                    tail_cluster_list->next = newNode;
+                    tail_cluster_list = newNode;
+                }
+
+                /* Move to the next extent once the current one is read */
+                clusters_done += cluster_count;
+
+                if (clusters_done == extents[i].Cluster_count)
+                {
+                    clusters_done = 0;
+                    i++;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            else
+            {
+                /* If the extent could not be read, stop reading the file */
+                free(buff);
+                i = extent_count;
+            }
+        }
+        else
+        {
+            /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            i = extent_count;
+        }
+    }
+
+    /* Free the extents */
+    free(extents);
+
+    return head_cluster_list;
+}
+
+/*
+ *@brief Deallocate a directory list.
+ *@param head - The head of the directory list to be deallocated.
+ *@returns No return value.
+ */
+void deallocate_Dir_List(DirList *head)
+{
+    /* Temporary variable to store the node to be deallocated */
+    DirList *tmp;
+
+    /* Loop through each node in the list */
+    while (NULL != head)
+    {
+        /* Store the current node in the temporary variable */
+        tmp = head;
+        /* Move the head to the next node */
+        head = head->next;
+        /* Deallocate the current node */
+        free(tmp);
+    }
+}
+
+/*
+ *@brief Deallocate a directory array.
+ *@param array - The directory array to be deallocated.
+ *@returns No return value.
+ */
+void deallocate_Dir_Array(DirArray *array)
+{
+    /* The entries are stored in the same allocation as the array, the long names in its arena */
+    if (NULL != array)
+    {
+        name_arena_release(array->names);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+    free(array);
+}
+
+/*
+ *@brief Deallocate directory columns.
+ *@param columns - The columns, or NULL.
+ *@returns No return value.
+ */
+void deallocate_Dir_Columns(fatfs_dir_columns_struct_t *columns)
+{
+    /* The columns are stored in the same allocation as the structure */
+    free(columns);
+}
+
+/*
+ *@brief Deallocate a cluster list.
+ *@param head - The head of the cluster list to be deallocated.
+ *@returns No return value.
+ */
+void deallocate_Cluster_List(ClusterList *head)
+{
+    /* Temporary variable to store the node to be deallocated */
+    ClusterList *tmp;
+
+    /* Loop through each node in the list */
+    while (NULL != head)
+    {
+        /* Store the current node in the temporary variable */
+        tmp = head;
+        /* Move the head to the next node */
+        head = head->next;
+        /* Deallocate the data in the cluster */
+        free(tmp->data_in_cluster);
+        /* Deallocate the current node */
+        free(tmp);
+    }
+}
+
+/*
+ *@brief De-initialize the FAT file system.
+ *@param None.
+ *@returns No return value.
+ */
+void fatfs_de_init(void)
+{
+    /* Deallocate the FAT table and the exFAT tables */
+    unmount_volume();
+    /* De-initialize the KMC */
+    kmc_de_init();
+}
+
+/*
+ *@brief Get the type of the mounted FAT file system.
+ *@param None.
+ *@returns Returns the FAT type.
+ */
+FATFS_TYPE fatfs_get_type(void)
+{
+    return s_FAT12Infor.Fat_type;
+}
+
+
+/*
+ *@brief Check whether a cluster is allocated.
+ *@param cluster - The cluster number to check.
+ *@returns Returns 1 if the cluster is allocated, 0 otherwise.
+ */
+uint8_t fatfs_is_cluster_allocated(uint32_t cluster)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (free) */
+
+    /* Only clusters of the data area can be allocated */
+    if (2 <= cluster && s_FAT12Infor.Cluster_count + 2 > cluster && NULL != s_fat_table)
+    {
+        /* exFAT records allocation in the bitmap, the FAT is only meaningful for fragmented streams */
+        if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+        {
+            result = exfat_is_run_allocated(cluster, 1);
+        }
+        else
+        {
+            result = (0 != get_fat_entry(cluster)) ? 1 : 0;
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Analyze the fragmentation of every file on the volume.
+ *@param volume - Receives the totals for the volume.
+ *@param callback - Called once per file, may be NULL.
+ *@returns Returns 1 if the analysis completed, 0 otherwise.
+ */
+uint8_t fatfs_analyze_fragmentation(fatfs_volume_fragmentation_struct_t *volume, FragmentationCallback callback)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (success) */
+    uint8_t *has_predecessor = NULL;
+    /* One bit per cluster, set when another FAT entry points to the cluster */
+    uint32_t cluster = 0;
+    /* Loop counter over the clusters */
+    uint32_t entry = 0;
+    /* The FAT entry of the current cluster */
+    uint32_t *chain = NULL;
+    /* The cluster chain of the current file */
+    uint32_t chain_length = 0;
+    /* The number of clusters in the chain */
+    uint32_t i = 0;
+    /* Loop counter over the chain */
+    fatfs_file_fragmentation_struct_t file;
+    /* The report of the current file */
+
+    memset(volume, 0, sizeof(fatfs_volume_fragmentation_struct_t));
+
+    /* Check that a volume is mounted */
+    if (NULL == s_fat_table)
+    {
+        result = 0;
+    }
+    else
+    {
+        has_predecessor = (uint8_t *)calloc((s_FAT12Infor.Cluster_count + 2 + 7) / 8, sizeof(uint8_t));
+
+        /* Check if memory allocation was successful */
+        if (NULL == has_predecessor)
+        {
+            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            result = 0;
+        }
+        else
+        {
+            /* First pass: mark every cluster that some FAT entry points to */
+            for (cluster = 2; cluster < s_FAT12Infor.Cluster_count + 2; cluster++)
+            {
+                entry = get_fat_entry(cluster);
+                if (2 <= entry && s_FAT12Infor.Cluster_count + 2 > entry)
+                {
+                    has_predecessor[entry / 8] |= (uint8_t)(1U << (entry % 8));
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+
+            /* Second pass: every used cluster without a predecessor starts a file, bad clusters are not files */
+            for (cluster = 2; cluster < s_FAT12Infor.Cluster_count + 2 && 1 == result; cluster++)
+            {
+                entry = get_fat_entry(cluster);
+                if (0 != entry && s_fat_bad_cluster[s_FAT12Infor.Fat_type] != entry && 0 == (has_predecessor[cluster / 8] & (1U << (cluster % 8))))
+                {
+                    chain = get_cluster_chain(cluster, &chain_length);
+
+                    if (0 != chain_length)
+                    {
+                        /* A new extent starts wherever the next cluster is not the physically following one */
+                        file.First_cluster = cluster;
+                        file.Cluster_count = chain_length;
+                        file.Extent_count = 1;
+                        for (i = 1; i < chain_length; i++)
+                        {
+                            if (chain[i] != chain[i - 1] + 1)
+                            {
+                                file.Extent_count++;
+                            }
+                            else
+                            {
+                                /* Do nothing */
+                            }
+                        }
+                        file.Average_extent_length = (float)file.Cluster_count / (float)file.Extent_count;
+                        file.Expected_seeks = file.Extent_count;
+
+                        /* Add the file to the volume totals */
+                        volume->File_count++;
+                        volume->Cluster_count += file.Cluster_count;
+                        volume->Extent_count += file.Extent_count;
+                        volume->Expected_seeks += file.Expected_seeks;
+                        if (1 < file.Extent_count)
+                        {
+                            volume->Fragmented_file_count++;
+                        }
+                        else
+                        {
+                            /* Do nothing */
+                        }
+
+                        if (NULL != callback)
+                        {
+                            callback(&file);
+                        }
+                        else
+                        {
+                            /* Do nothing */
+                        }
+                    }
+                    else if (NULL == chain)
+                    {
+                        /* Memory allocation failed while walking the chain, the error callback has been called */
+                        result = 0;
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+
+                    free(chain);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+
+            if (0 != volume->Extent_count)
+            {
+                volume->Average_extent_length = (float)volume->Cluster_count / (float)volume->Extent_count;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            free(has_predecessor);
+        }
+    }
+
+    return result;
+}
+
+/*
+ *@brief Rebuild the exFAT stream table after the image changed.
+ *@details The layout of a stream is only known from the directory entry set that describes it. Every directory
+ *         that was listed before is decoded again, starting from the root so that a parent is always decoded
+ *         before its subdirectories, which registers the streams they contain with their current layout.
+ *@param None.
+ *@returns No return value.
+ */
+static void exfat_rebuild_streams(void)
+{
+    fatfs_exfat_stream_struct_t *old_streams = s_exfat_streams;
+    /* The table before the change */
+    uint32_t old_capacity = s_exfat_stream_capacity;
+    /* The number of slots of the old table */
+    uint32_t *listed = NULL;
+    /* Set of the directories listed before the change, open addressed, 1 marking a directory already queued */
+    uint32_t *queue = NULL;
+    /* The directories to decode again, root first */
+    uint32_t queue_count = 0;
+    /* The number of directories queued */
+    uint32_t head = 0;
+    /* The next directory to decode */
+    uint32_t slot = 0;
+    /* The slot being probed */
+    uint32_t i = 0;
+    /* Loop counter */
+    DirIterator *iterator = NULL;
+    /* The iterator decoding a directory */
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The entry read from the directory */
+
+    s_exfat_streams = NULL;
+    s_exfat_stream_capacity = 0;
+    s_exfat_stream_count = 0;
+
+    /* The old table is at most half full, so a set of its capacity holds every parent directory */
+    if (0 != old_capacity)
+    {
+        listed = (uint32_t *)calloc(old_capacity, sizeof(uint32_t));
+        queue = (uint32_t *)malloc((old_capacity + 1) * sizeof(uint32_t));
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (NULL != listed && NULL != queue)
+    {
+        /* A directory was listed before if it is the parent of a stream */
+        for (i = 0; i < old_capacity; i++)
+        {
+            if (0 != old_streams[i].First_cluster && 0 != old_streams[i].Parent_cluster)
+            {
+                slot = (old_streams[i].Parent_cluster * 2654435761U) & (old_capacity - 1);
+                while (0 != listed[slot] && old_streams[i].Parent_cluster != listed[slot])
+                {
+                    slot = (slot + 1) & (old_capacity - 1);
+                }
+                listed[slot] = old_streams[i].Parent_cluster;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
+
+        /* Decode the root, then every listed subdirectory reached from it */
+        queue[queue_count++] = 0;
+        while (head < queue_count)
+        {
+            iterator = fatfs_opendir(queue[head]);
+            head++;
+
+            entry = fatfs_readdir(iterator);
+            while (NULL != entry)
+            {
+                if (0 != ((entry->Attributes >> 4) & 1) && '.' != entry->File_name[0] && 2 <= entry->First_Logical_Cluster)
+                {
+                    slot = (entry->First_Logical_Cluster * 2654435761U) & (old_capacity - 1);
+                    while (0 != listed[slot] && entry->First_Logical_Cluster != listed[slot])
+                    {
+                        slot = (slot + 1) & (old_capacity - 1);
+                    }
+
+                    /* Queue a listed directory once, a cycle in a damaged volume must not loop */
+                    if (0 != listed[slot])
+                    {
+                        listed[slot] = 1;
+                        queue[queue_count++] = entry->First_Logical_Cluster;
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+
+                entry = fatfs_readdir(iterator);
+            }
+            fatfs_closedir(iterator);
+        }
+    }
+    else if (0 != old_capacity)
+    {
+        error_callback(DYNAMIC_ALLOCATON_ERROR);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    free(queue);
+    free(listed);
+    free(old_streams);
+}
+
+/*
+ *@brief Check whether the image changed and refresh the mounted state.
+ *@param None.
+ *@returns Returns 1 if the image changed, 0 otherwise.
+ */
+uint8_t fatfs_check_for_changes(void)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (unchanged) */
+    uint8_t change = KMC_CHANGE_UNKNOWN;
+    /* What the image watcher knows about changes */
+    kmc_image_stamp_struct_t stamp;
+    /* The current stamp of the image */
+    uint8_t *buff = NULL;
+    /* Buffer holding the current boot sector */
+
+    /* Check that a volume is mounted */
+    if (NULL != s_fat_table)
+    {
+        /* Ask the watcher first, and compare stamps only when it cannot tell */
+        change = kmc_poll_changes();
+        if (KMC_CHANGE_UNKNOWN == change && 0 != kmc_get_image_stamp(&stamp))
+        {
+            if (stamp.size != s_image_stamp.size || stamp.mtime != s_image_stamp.mtime || stamp.mtime_nsec != s_image_stamp.mtime_nsec ||
+                stamp.inode != s_image_stamp.inode)
+            {
+                change = KMC_CHANGE_DETECTED;
+            }
+            else
+            {
+                change = KMC_CHANGE_NONE;
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Read through a fresh handle, the image may have been replaced by a new file. If it cannot be opened,
+        the stamp is kept so that the change is found again by the next call, and nothing is read from the old handle */
+        if (KMC_CHANGE_DETECTED == change && 0 != kmc_reopen())
+        {
+            result = 1;
+            s_generation++;
+
+            /* A stamp that cannot be read is cleared, so that the next stamp that can be read differs from it */
+            if (0 == kmc_get_image_stamp(&s_image_stamp))
+            {
+                memset(&s_image_stamp, 0, sizeof(s_image_stamp));
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            buff = (uint8_t *)calloc(KMC_DEFAULT_SECTOR_SIZE, sizeof(uint8_t));
+
+            /* Check if memory allocation was successful */
+            if (NULL != buff)
+            {
+                /* Read the boot sector with the sector size it is stored with */
+                kmc_update_sector_size(KMC_DEFAULT_SECTOR_SIZE);
+                kmc_read_sector(0, buff);
+                kmc_update_sector_size(s_FAT12Infor.bytes_per_sector);
+
+                /* A different boot sector means a different volume layout, so everything is mounted again */
+                if (0 != memcmp(buff, s_boot_sector, KMC_DEFAULT_SECTOR_SIZE))
+                {
+                    unmount_volume();
+                    mount_volume();
+                }
+                else
+                {
+                    /* Same layout: refresh only the FAT sectors that changed */
+                    refresh_fat_table();
+
+                    /* exFAT allocation and stream layouts live in directory entries, which may have changed anywhere */
+                    if (FATFS_TYPE_EXFAT == s_FAT12Infor.Fat_type)
+                    {
+                        free(s_allocation_bitmap);
+                        s_allocation_bitmap = NULL;
+                        s_allocation_bitmap_size = 0;
+                        exfat_load_allocation_bitmap();
+                        exfat_rebuild_streams();
+                    }
+                    else
+                    {
+                        /* Do nothing */
+                    }
+                }
+
+                /* The directories may have changed anywhere, so the tree index is built again */
+                tree_index_release();
+                if (0 != (s_mount_options & FATFS_MOUNT_TREE_INDEX) && 0 != tree_index_build())
+                {
+                    snapshot_save();
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+
+                free(buff);
+            }
+            else
+            {
+                error_callback(DYNAMIC_ALLOCATON_ERROR);
+            }
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Get the generation of the mounted image.
+ *@param None.
+ *@returns Returns the number of changes detected since the image was mounted.
+ */
+uint32_t fatfs_get_generation(void)
+{
+    return s_generation;
+}
+/*
+ *@brief Set the memory budget of the cluster chain cache.
+ *@param budget - The maximum number of bytes the cache may use, 0 to disable it.
+ *@returns No return value.
+ */
+void fatfs_set_chain_cache_budget(uint32_t budget)
+{
+    s_chain_cache_budget = budget;
+
+    /* Evict the least recently used chains until the cache fits in the new budget */
+    chain_cache_evict(0);
+}
+
+/*
+ *@brief Find a file or directory by path.
+ *@param path - The path of the file or directory, components separated by '/' or '\\'.
+ *@param entry - Receives the directory entry of the file or directory.
+ *@returns Returns 1 if the path was found, 0 otherwise.
+ */
+uint8_t fatfs_open(const char *path, fatfs_directory_entry_list_struct_t *entry)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not found) */
+    uint32_t start = 0;
+    /* Position of the first character of the current component */
+    uint32_t end = 0;
+    /* Position just after the last character of the current component */
+    fatfs_name_key_struct_t key;
+    /* The packed name of the current component */
+
+    /* Check that a volume is mounted and the arguments are valid */
+    if (NULL != s_fat_table && NULL != path && NULL != entry)
+    {
+        /* Start from the root directory, which has no entry of its own */
+        memset(entry, 0, sizeof(fatfs_directory_entry_list_struct_t));
+        memset(entry->File_name, ' ', 8);
+        memset(entry->Extension, ' ', 3);
+        make_name_key(entry->File_name, entry->Extension, &entry->Name_key);
+        entry->Attributes = 0x10;
+        result = 1;
+
+        /* Resolve one component at a time; empty and "." components stay in the same directory */
+        while (0 != result && '\0' != path[start])
+        {
+            end = start;
+            while ('\0' != path[end] && '/' != path[end] && '\\' != path[end])
+            {
+                end++;
+            }
+
+            if (end == start || (1 == end - start && '.' == path[start]))
+            {
+                /* Do nothing */
+            }
+            /* Every component but the last one must be a directory */
+            else if (0 == ((entry->Attributes >> 4) & 1))
+            {
+                result = 0;
+            }
+            /* Short names go through the dentry cache, anything else is compared with the long names */
+            else if (0 != make_path_name_key(&path[start], end - start, &key) && 0 != dentry_lookup(entry->First_Logical_Cluster, &key, entry))
+            {
+                /* Do nothing */
+            }
+            else
+            {
+                result = dir_cache_lookup_long_name(entry->First_Logical_Cluster, &path[start], end - start, entry);
+            }
+
+            start = ('\0' == path[end]) ? end : end + 1;
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Find a name in a directory.
+ *@param First_Logical_Directory_of_current - The first logical directory of the directory, 0 for the root directory.
+ *@param name - The 8.3 name or the long name to find, for example "FILE.TXT".
+ *@param entry - Receives the directory entry if it is found.
+ *@returns Returns 1 if the name was found, 0 otherwise.
+ */
+uint8_t fatfs_lookup(uint32_t First_Logical_Directory_of_current, const char *name, fatfs_directory_entry_list_struct_t *entry)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (not found) */
+    fatfs_name_key_struct_t key;
+    /* The packed name */
+
+    /* Check that a volume is mounted and the arguments are valid */
+    if (NULL != s_fat_table && NULL != name && NULL != entry)
+    {
+        if (0 != make_path_name_key(name, (uint32_t)strlen(name), &key))
+        {
+            result = dir_cache_lookup(First_Logical_Directory_of_current, &key, entry);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        /* Fall back to the long names */
+        if (0 == result)
+        {
+            result = dir_cache_lookup_long_name(First_Logical_Directory_of_current, name, (uint32_t)strlen(name), entry);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Search the whole volume for entries matching a query.
+ *@param query - The predicates an entry must satisfy.
+ *@param callback - Called once per matching entry, returns 0 to stop the search.
+ *@param context - Passed unchanged to the callback.
+ *@returns Returns the number of matches reported to the callback.
+ */
+uint32_t fatfs_find(const fatfs_find_query_struct_t *query, FindCallback callback, void *context)
+{
+    uint32_t matches = 0;
+    /* The number of matches reported */
+    fatfs_find_frame_struct_t frames[FATFS_FIND_MAX_DEPTH + 1];
+    /* The directories open from the root directory down to the one being searched */
+    uint32_t depth = 0;
+    /* The number of open directories */
+    char path[FATFS_FIND_MAX_PATH];
+    /* The path of the entry being tested */
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The entry being tested */
+    fatfs_find_frame_struct_t *frame = NULL;
+    /* The directory being searched */
+    uint32_t length = 0;
+    /* The length of the path of the entry */
+    uint8_t running = 1;
+    /* Cleared when the callback stops the search */
+
+    /* Check that a volume is mounted and the arguments are valid */
+    if (NULL != s_fat_table && NULL != query && NULL != callback)
+    {
+        find_open_directory(&frames[0], 0, 0);
+        depth = 1;
+
+        /* Depth first: an entry is tested when it is decoded, and a directory is searched as soon as it is found */
+        while (0 != depth)
+        {
+            frame = &frames[depth - 1];
+            entry = (0 != running) ? find_next_entry(frame) : NULL;
+
+            if (NULL == entry)
+            {
+                fatfs_closedir(frame->Iterator);
+                depth--;
+            }
+            /* Deleted entries, "." and ".." are not reported */
+            else if (FATFS_DELETED_ENTRY == (uint8_t)entry->File_name[0] || 0 != is_dot_entry(entry))
+            {
+                /* Do nothing */
+            }
+            else
+            {
+                path[frame->Path_length] = '/';
+                length = frame->Path_length + 1 + format_short_name(entry->File_name, entry->Extension, &path[frame->Path_length + 1]);
+
+                if (0 != find_match_entry(query, entry, &path[frame->Path_length + 1]))
+                {
+                    matches++;
+                    running = callback(entry, path, context);
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+
+                /* A directory entry with first cluster 0 is not a subdirectory and would search the root directory again */
+                if (0 != running && 0 != ((entry->Attributes >> 4) & 1) && 0 != entry->First_Logical_Cluster && FATFS_FIND_MAX_DEPTH >= depth)
+                {
+                    find_open_directory(&frames[depth], entry->First_Logical_Cluster, length);
+                    depth++;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return matches;
+}
+
+/*
+ *@brief Find every deleted entry of the volume.
+ *@param callback - Called once per deleted entry.
+ *@param context - Passed unchanged to the callback.
+ *@returns Returns the number of deleted entries reported.
+ */
+uint32_t fatfs_scan_deleted(RecoveryCallback callback, void *context)
+{
+    fatfs_recovery_scan_struct_t *scan = NULL;
+    /* The state of the scan */
+    uint8_t *buff = NULL;
+    /* Buffer receiving a run of sectors */
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    uint32_t bitmap_size = (s_FAT12Infor.Cluster_count + 2 + 7) / 8;
+    /* The number of bytes of one bitmap */
+    uint32_t run_clusters = 0;
+    /* The number of clusters read at once */
+    uint32_t cluster = 2;
+    /* The first cluster of the run being read */
+    uint32_t count = 0;
+    /* The number of clusters or sectors in the run being read */
+    uint32_t sector = 0;
+    /* The next sector of the fixed root directory region */
+    uint32_t remaining = 0;
+    /* The number of sectors of the fixed root directory region left to read */
+    uint8_t end = 0;
+    /* Set when the end of the fixed root directory region was found */
+    uint8_t progress = 1;
+    /* Set while the catch-up loop finds directory clusters left to scan */
+    uint32_t found = 0;
+    /* The number of deleted entries reported */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* Check that a FAT12, FAT16 or FAT32 volume is mounted and the callback is valid */
+    if (NULL != s_fat_table && NULL != callback && FATFS_TYPE_EXFAT != s_FAT12Infor.Fat_type)
+    {
+        run_clusters = (FATFS_RECOVERY_READ_SIZE > Cluster_size) ? FATFS_RECOVERY_READ_SIZE / Cluster_size : 1;
+        scan = (fatfs_recovery_scan_struct_t *)calloc(1, sizeof(fatfs_recovery_scan_struct_t) + 2 * bitmap_size);
+        buff = (uint8_t *)malloc(run_clusters * Cluster_size);
+
+        if (NULL != scan && NULL != buff)
         {
-            /* Read multiple sectors from the root directory into the buffer */
-            number_of_bytes_read = kmc_read_multi_sector((cluster_started_in_physical_of_rootdirectory * s_FAT12Infor.bytes_per_sector), num_cluster_in_root_directory, buff);
+            scan->Directories = (uint8_t *)(scan + 1);
+            scan->Scanned = scan->Directories + bitmap_size;
+            scan->Callback = callback;
+            scan->Context = context;
 
-            /* Check if the correct number of bytes were read */
-            if (number_of_bytes_read == (s_FAT12Infor.bytes_per_sector * num_cluster_in_root_directory))
+            /* The root directory comes first: a cluster chain on FAT32, the fixed region before the data area otherwise */
+            if (FATFS_TYPE_FAT32 == s_FAT12Infor.Fat_type)
+            {
+                recovery_mark_directory(scan, s_FAT12Infor.Root_cluster);
+            }
+            else
             {
-                /* Loop through each directory entry in the buffer */
-                for (i = 0; i < number_of_bytes_read; i += 32)
+                sector = cluster_started_in_physical_of_rootdirectory;
+                remaining = num_cluster_in_root_directory;
+                while (0 != remaining && 0 == end)
                 {
-                    /* Check if the directory entry is valid
-                    If the Attributes byte is 0x0F, then this directory entry is part of a long file name and can be ignored for purposes of this assignment.
-                    If the first byte of the Filename field is 0x00, then this directory entry is free and all the remaining directory entries in this directory are also free. */
-                    if (0 != buff[i] && 0x0F != buff[i + 11])
-                    {
-                        /* Copy the file name, extension, attributes, creation time and date, last write time and date, first logical cluster, and file size in bytes from the buffer to the directory list structure */
-                        memcpy(&s_dirList.File_name, &buff[i], 8);
-                        s_dirList.File_name[8] = '\0';
-                        memcpy(&s_dirList.Extension, &buff[i + 8], 3);
-                        s_dirList.Extension[4] = '\0';
-                        memcpy(&s_dirList.Attributes, &buff[i + 11], 1);
-                        memcpy(&s_dirList.Creation_Time, &buff[i + 14], 2);
-                        memcpy(&s_dirList.Creation_Date, &buff[i + 16], 2);
-                        memcpy(&s_dirList.Last_Write_Time, &buff[i + 22], 2);
-                        memcpy(&s_dirList.Last_Write_Date, &buff[i + 24], 2);
-                        memcpy(&s_dirList.First_Logical_Cluster, &buff[i + 26], 2);
-                        memcpy(&s_dirList.File_Size_in_bytes, &buff[i + 28], 4);
-
-                        /* Create a new directory entry node */
-                        newNode = createNodeEntry();
-                        /* Copy the directory list data to the new node */
-                        memcpy(&newNode->data, &s_dirList, sizeof(fatfs_directory_entry_list_struct_t));
-
-                        /* If the directory list is empty, set the head and tail to the new node */
-                        if (NULL == head)
-                        {
-                            head = newNode;
-                            tail = newNode;
-                        }
-                        else
-                        {
-                            /* If the directory list is not empty, add the new node to the end of the list */
-                            tail->next = newNode;
-                            tail = newNode;
-                        }
-                    }
-                    /* If the first byte of the Filename field is 0x00, then this directory entry is free and all the remaining directory entries in this directory are also free. */
-                    else if (0 == buff[i])
+                    count = (remaining < run_clusters * s_FAT12Infor.sectors_per_cluster) ? remaining : run_clusters * s_FAT12Infor.sectors_per_cluster;
+                    if ((uint64_t)count * s_FAT12Infor.bytes_per_sector == kmc_read_multi_sector((uint64_t)sector * s_FAT12Infor.bytes_per_sector, count, buff))
                     {
-                        i = number_of_bytes_read;
+                        end = recovery_scan_entries(scan, buff, count * s_FAT12Infor.bytes_per_sector / FATFS_DIRECTORY_ENTRY_SIZE, 0,
+                                                    (sector - cluster_started_in_physical_of_rootdirectory) * s_FAT12Infor.bytes_per_sector / FATFS_DIRECTORY_ENTRY_SIZE, 0);
+                        sector += count;
+                        remaining -= count;
                     }
                     else
                     {
-                        /* Do nothing */
+                        error_callback(ERROR_READING_ROOT_DIRECTORY);
+                        end = 1;
                     }
                 }
-
-                /* Free the memory allocated for the buffer */
-                free(buff);
-                buff = NULL;
             }
-            else
+
+            /* One sequential pass over the data area, a run of clusters at a time */
+            while (s_FAT12Infor.Cluster_count + 2 > cluster)
             {
-                /* If reading the root directory failed, call the error callback with the appropriate error code */
-                error_callback(ERROR_READING_ROOT_DIRECTORY);
+                count = (s_FAT12Infor.Cluster_count + 2 - cluster < run_clusters) ? s_FAT12Infor.Cluster_count + 2 - cluster : run_clusters;
+                if ((uint64_t)count * Cluster_size == kmc_read_multi_sector(get_cluster_offset(cluster), count * s_FAT12Infor.sectors_per_cluster, buff))
+                {
+                    for (i = 0; i < count; i++)
+                    {
+                        recovery_scan_cluster(scan, cluster + i, &buff[i * Cluster_size]);
+                    }
+                    cluster += count;
+                }
+                else
+                {
+                    /* The image ends before the data area does */
+                    error_callback(MULTIPLE_SECTOR_READ_ERROR);
+                    cluster = s_FAT12Infor.Cluster_count + 2;
+                }
             }
-        }
-        else
-        {
-            /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
-            error_callback(DYNAMIC_ALLOCATON_ERROR);
-        }
-    }
-    else
-    {
-        /* Allocate memory for the buffer */
-        buff = (uint8_t *)calloc(s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector, sizeof(uint8_t));
 
-        /* Check if memory allocation was successful */
-        if (NULL != buff)
-        {
-            /* Loop until the end of the FAT is reached */
-            do
+            /* Directory clusters marked after the pass went by them are read one by one, until none is left */
+            while (0 != progress)
             {
-                /* Read multiple sectors from the subdirectory into the buffer */
-                number_of_bytes_read = kmc_read_multi_sector(((Cluster_starts_in_physical_of_the_data_area - 2 + First_Logical_Directory_of_current) * s_FAT12Infor.bytes_per_sector), s_FAT12Infor.sectors_per_cluster, buff);
-
-                /* Check if the correct number of bytes were read */
-                if (number_of_bytes_read == (s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector))
+                progress = 0;
+                for (cluster = 2; cluster < s_FAT12Infor.Cluster_count + 2; cluster++)
                 {
-                    /* Loop through each directory entry in the buffer */
-                    for (i = 0; i < number_of_bytes_read; i += 32)
+                    if (0 != (scan->Directories[cluster / 8] & ~scan->Scanned[cluster / 8] & (1U << (cluster % 8))))
                     {
-                        /* Check if the directory entry is valid
-                        If the Attributes byte is 0x0F, then this directory entry is part of a long file name and can be ignored for purposes of this assignment.
-                        If the first byte of the Filename field is 0x00, then this directory entry is free and all the remaining directory entries in this directory are also free. */
-                        if (0 != buff[i] && 0x0F != buff[i + 11])
-                        {
-                            /* Copy the file name, extension, attributes, creation time and date, last write time and date, first logical cluster,
-                             and file size in bytes from the buffer to the directory list structure */
-                            memcpy(&s_dirList.File_name, &buff[i], 8);
-                            s_dirList.File_name[8] = '\0';
-                            memcpy(&s_dirList.Extension, &buff[i + 8], 3);
-                            s_dirList.Extension[4] = '\0';
-                            memcpy(&s_dirList.Attributes, &buff[i + 11], 1);
-                            memcpy(&s_dirList.Creation_Time, &buff[i + 14], 2);
-                            memcpy(&s_dirList.Creation_Date, &buff[i + 16], 2);
-                            memcpy(&s_dirList.Last_Write_Time, &buff[i + 22], 2);
-                            memcpy(&s_dirList.Last_Write_Date, &buff[i + 24], 2);
-                            memcpy(&s_dirList.First_Logical_Cluster, &buff[i + 26], 2);
-                            memcpy(&s_dirList.File_Size_in_bytes, &buff[i + 28], 4);
-
-                            /* Ignore if entry points to current directory */
-                            if (First_Logical_Directory_of_current != s_dirList.First_Logical_Cluster)
-                            {
-                                /* Create a new directory entry node */
-                                newNode = createNodeEntry();
-                                /* Copy the directory list data to the new node */
-                                memcpy(&newNode->data, &s_dirList, sizeof(fatfs_directory_entry_list_struct_t));
-
-                                /* If the directory list is empty, set the head and tail to the new node */
-                                if (NULL == head)
-                                {
-                                    head = newNode;
-                                    tail = newNode;
-                                }
-                                else
-                                {
-                                    /* If the directory list is not empty, add the new node to the end of the list */
-                                    tail->next = newNode;
-                                    tail = newNode;
-                                }
-                            }
-                            else
-                            {
-                                /* Do nothing*/
-                            }
-                        }
-                        /* If the first byte of the Filename field is 0x00, then this directory entry is free and all the remaining directory entries in this directory are also free. */
-                        else if (0 == buff[i])
+                        /* A cluster that cannot be read is not retried */
+                        scan->Scanned[cluster / 8] |= (uint8_t)(1U << (cluster % 8));
+                        if (Cluster_size == kmc_read_multi_sector(get_cluster_offset(cluster), s_FAT12Infor.sectors_per_cluster, buff))
                         {
-                            i = number_of_bytes_read;
+                            recovery_scan_cluster(scan, cluster, buff);
                         }
                         else
                         {
                             /* Do nothing */
                         }
+                        progress = 1;
+                    }
+                    else
+                    {
+                        /* Do nothing */
                     }
-
-                    /* Get the next FAT entry */
-                    First_Logical_Directory_of_current = get_fat_entry_next(First_Logical_Directory_of_current);
-                    /* Reset the buffer */
-                    buff = NULL;
-                }
-                else
-                {
-                    /* If reading the subdirectory failed, call the error callback with the appropriate error code */
-                    error_callback(ERROR_READING_SUB_DIRECTORY);
                 }
+            }
 
-                /* Continue looping until the end of the FAT is reached */
-            } while (0xFF7 > First_Logical_Directory_of_current);
-
-            /* Free the memory allocated for the buffer */
-            free(buff);
+            found = scan->Found;
         }
         else
         {
-            /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
+            /* If memory allocation failed, call the error callback with the appropriate error code */
             error_callback(DYNAMIC_ALLOCATON_ERROR);
         }
+
+        free(buff);
+        free(scan);
+    }
+    else
+    {
+        /* Do nothing */
     }
 
-    /* Return the head of the directory list */
-    return head;
+    return found;
 }
 
 /*
- *@brief Read a file from the FAT file system.
- *@param First_Logical_Cluster_of_current - The first logical cluster of the current file.
- *@returns Returns a pointer to the head of the cluster list.
+ *@brief Compute the disk usage of a directory tree.
+ *@param First_Logical_Cluster - The first cluster of the directory, 0 for the root directory.
+ *@param usage - Receives the totals.
+ *@returns Returns 1 on success, 0 otherwise.
  */
-ClusterList *fatfs_read_file(uint16_t First_Logical_Cluster_of_current)
+uint8_t fatfs_disk_usage(uint32_t First_Logical_Cluster, fatfs_disk_usage_struct_t *usage)
 {
-    uint16_t fat_entry_next = 0;
-    /* Variables to store the next FAT entry */
-    uint8_t *buff = NULL;
-    /* Buffer to store the data read from the file system */
-    uint32_t number_of_bytes_read = 0;
-    /* Variable to store the number of bytes read */
-    ClusterList *head_cluster_list = NULL;
-    /* the head of the cluster list*/
-    ClusterList *tail_cluster_list = NULL;
-    /* the tail of the cluster list */
-    ClusterList *newNode = NULL;
-    /* the new node of the cluster list */
+    uint8_t result = 0;
+    /* Default result is 0 (failure) */
+    const fatfs_du_memo_struct_t *memo = NULL;
+    /* The remembered totals of a directory */
+    fatfs_du_frame_struct_t *frames = NULL;
+    /* The directories open from the requested directory down to the one being read */
+    fatfs_du_frame_struct_t *grown = NULL;
+    /* The frames after they have grown */
+    uint32_t capacity = 16;
+    /* The number of frames allocated */
+    uint32_t depth = 0;
+    /* The number of open directories */
+    const fatfs_directory_entry_list_struct_t *entry = NULL;
+    /* The entry being counted */
+    fatfs_du_frame_struct_t *frame = NULL;
+    /* The directory being read */
+    uint32_t Cluster_size = s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector;
+    /* The size of one cluster in bytes */
+    uint32_t i = 0;
+    /* Loop counter */
 
-    /* Loop until the end of the FAT is reached */
-    do
+    /* Check that a volume is mounted and the arguments are valid */
+    if (NULL != s_fat_table && NULL != usage)
     {
-        /* Allocate memory for the buffer, buff will be freed when the linked list is deallocated,
-        specifically, it will be freed in the deallocate_Cluster_List function  */
-        buff = (uint8_t *)calloc(s_FAT12Infor.sectors_per_cluster * s_FAT12Infor.bytes_per_sector, sizeof(uint8_t));
-
-        /* Check if memory allocation was successful */
-        if (NULL != buff)
+        memo = du_memo_find(First_Logical_Cluster);
+        if (NULL != memo)
+        {
+            *usage = memo->Usage;
+            result = 1;
+        }
+        else
         {
-            /* Read multiple sectors from the file into the buffer */
-            number_of_bytes_read = kmc_read_multi_sector(((Cluster_starts_in_physical_of_the_data_area - 2 + First_Logical_Cluster_of_current) * s_FAT12Infor.bytes_per_sector), s_FAT12Infor.sectors_per_cluster, buff);
+            frames = (fatfs_du_frame_struct_t *)malloc(capacity * sizeof(fatfs_du_frame_struct_t));
+            if (NULL != frames)
+            {
+                du_open_directory(&frames[0], First_Logical_Cluster);
+                depth = 1;
+                result = 1;
+            }
+            else
+            {
+                error_callback(DYNAMIC_ALLOCATON_ERROR);
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Depth first: a directory is complete when its last entry has been read, and its totals are then added to its parent */
+    while (0 != depth && 0 != result)
+    {
+        frame = &frames[depth - 1];
+        entry = find_next_entry(&frame->Walk);
 
-            /* Check if the correct number of bytes were read */
-            if (number_of_bytes_read == (s_FAT12Infor.bytes_per_sector * s_FAT12Infor.sectors_per_cluster))
+        if (NULL == entry)
+        {
+            fatfs_closedir(frame->Walk.Iterator);
+            frame->Walk.Iterator = NULL;
+            result = du_memo_store(frame->Cluster, &frame->Usage);
+            depth--;
+            if (0 != depth)
             {
-                /* Create a new cluster node */
-                newNode = createNodeCluster();
+                du_add_directory(&frames[depth - 1].Usage, &frame->Usage);
+            }
+            else
+            {
+                *usage = frame->Usage;
+            }
+        }
+        /* Deleted entries, "." and ".." and the volume label are not counted */
+        else if (FATFS_DELETED_ENTRY == (uint8_t)entry->File_name[0] || 0 != is_dot_entry(entry) || 0 != ((entry->Attributes >> 3) & 1))
+        {
+            /* Do nothing */
+        }
+        else if (0 != ((entry->Attributes >> 4) & 1))
+        {
+            memo = (0 != entry->First_Logical_Cluster) ? du_memo_find(entry->First_Logical_Cluster) : NULL;
 
-                /* Assign the data in the buffer to the new node */
-                newNode->data_in_cluster = buff;
+            /* A directory open further up is a cycle in a damaged volume, it is counted but not entered again */
+            i = 0;
+            while (NULL == memo && i < depth && frames[i].Cluster != entry->First_Logical_Cluster)
+            {
+                i++;
+            }
 
-                /* If the cluster list is empty, set the head and tail to the new node */
-                if (NULL == head_cluster_list)
+            if (NULL != memo)
+            {
+                du_add_directory(&frame->Usage, &memo->Usage);
+            }
+            else if (0 == entry->First_Logical_Cluster || i < depth)
+            {
+                frame->Usage.Directory_count++;
+            }
+            else
+            {
+                if (depth == capacity)
                 {
-                    head_cluster_list = newNode;
-                    tail_cluster_list = newNode;
+                    grown = (fatfs_du_frame_struct_t *)realloc(frames, 2 * capacity * sizeof(fatfs_du_frame_struct_t));
+                    if (NULL != grown)
+                    {
+                        frames = grown;
+                        capacity *= 2;
+                    }
+                    else
+                    {
+                        error_callback(DYNAMIC_ALLOCATON_ERROR);
+                        result = 0;
+                    }
                 }
                 else
                 {
-                    /* If the cluster list is not empty, add the new node to the end of the list */
-                    tail_cluster_list->next = newNode;
-                    tail_cluster_list = newNode;
+                    /* Do nothing */
                 }
 
-                /* Get the next FAT entry */
-                First_Logical_Cluster_of_current = get_fat_entry_next(First_Logical_Cluster_of_current);
-            }
-            else
-            {
-                /* If the incorrect number of bytes were read, do nothing */
+                if (0 != result)
+                {
+                    du_open_directory(&frames[depth], entry->First_Logical_Cluster);
+                    depth++;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
             }
         }
         else
         {
-            /* If memory allocation for the buffer failed, call the error callback with the appropriate error code */
-            error_callback(DYNAMIC_ALLOCATON_ERROR);
+            frame->Usage.File_count++;
+            frame->Usage.Logical_size += entry->File_Size_in_bytes;
+            frame->Usage.Allocated_size += (uint64_t)du_count_clusters(entry->First_Logical_Cluster) * Cluster_size;
         }
+    }
 
-        /* Continue looping until the end of the FAT is reached */
-    } while (0xFF7 > First_Logical_Cluster_of_current);
+    /* Directories left open by a failure are closed */
+    while (0 != depth)
+    {
+        depth--;
+        fatfs_closedir(frames[depth].Walk.Iterator);
+    }
+    free(frames);
 
-    return head_cluster_list;
+    return result;
 }
 
 /*
- *@brief Deallocate a directory list.
- *@param head - The head of the directory list to be deallocated.
+ *@brief Fill the tables used to convert FAT dates and times to epoch seconds.
+ *@param None.
  *@returns No return value.
  */
-void deallocate_Dir_List(DirList *head)
+static void timestamp_tables_build(void)
 {
-    /* Temporary variable to store the node to be deallocated */
-    DirList *tmp;
+    static const uint16_t days_before_month[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+    /* The number of days before the first of each month in a year that is not a leap year */
+    uint32_t days = FATFS_DAYS_FROM_1970_TO_1980;
+    /* The number of days from the Unix epoch to the first of January of the year */
+    uint32_t year = 0;
+    /* The calendar year */
+    uint32_t month = 0;
+    /* The month bits of the date */
+    uint32_t valid_month = 0;
+    /* The month counted from 0, with an out of range month moved to the nearest valid one */
+    uint8_t leap = 0;
+    /* Set if the year is a leap year */
+    uint32_t i = 0;
+    /* Loop counter */
 
-    /* Loop through each node in the list */
-    while (NULL != head)
+    /* The 7 year bits cover the 128 years from 1980 to 2107 */
+    for (year = 1980; year < 1980 + (FATFS_DATE_TABLE_SIZE >> 4); year++)
     {
-        /* Store the current node in the temporary variable */
-        tmp = head;
-        /* Move the head to the next node */
-        head = head->next;
-        /* Deallocate the current node */
-        free(tmp);
+        leap = (0 == year % 4 && (0 != year % 100 || 0 == year % 400)) ? 1 : 0;
+        for (month = 0; month < 16; month++)
+        {
+            valid_month = (0 == month) ? 0 : ((12 < month) ? 11 : month - 1);
+            s_date_days[((year - 1980) << 4) | month] = days + days_before_month[valid_month] + ((1 < valid_month) ? leap : 0);
+        }
+        days += 365 + leap;
     }
+
+    /* The hour is in the upper 5 bits and the minute in the lower 6 bits of the index */
+    for (i = 0; i < FATFS_TIME_TABLE_SIZE; i++)
+    {
+        s_time_seconds[i] = (i >> 6) * 3600 + (i & 0x3F) * 60;
+    }
+
+    s_timestamp_tables_ready = 1;
 }
 
 /*
- *@brief Deallocate a cluster list.
- *@param head - The head of the cluster list to be deallocated.
+ *@brief Decode a FAT date and time.
+ *@param date - The date, as stored in a directory entry.
+ *@param time - The time, as stored in a directory entry.
+ *@param timestamp - Receives the decoded date and time.
  *@returns No return value.
  */
-void deallocate_Cluster_List(ClusterList *head)
+void fatfs_decode_timestamp(uint16_t date, uint16_t time, fatfs_timestamp_struct_t *timestamp)
 {
-    /* Temporary variable to store the node to be deallocated */
-    ClusterList *tmp;
+    if (0 == s_timestamp_tables_ready)
+    {
+        timestamp_tables_build();
+    }
+    else
+    {
+        /* Do nothing */
+    }
 
-    /* Loop through each node in the list */
-    while (NULL != head)
+    timestamp->Year = (uint16_t)((date >> 9) + 1980);
+    timestamp->Month = (uint8_t)((date >> 5) & 0x0F);
+    timestamp->Day = (uint8_t)(date & 0x1F);
+    timestamp->Hour = (uint8_t)(time >> 11);
+    timestamp->Minute = (uint8_t)((time >> 5) & 0x3F);
+    timestamp->Second = (uint8_t)((time & 0x1F) * 2);
+
+    /* A day of 0 marks a date that was never set */
+    if (0 != timestamp->Day)
     {
-        /* Store the current node in the temporary variable */
-        tmp = head;
-        /* Move the head to the next node */
-        head = head->next;
-        /* Deallocate the data in the cluster */
-        free(tmp->data_in_cluster);
-        /* Deallocate the current node */
-        free(tmp);
+        timestamp->Epoch = (int64_t)(s_date_days[date >> 5] + timestamp->Day - 1) * FATFS_SECONDS_PER_DAY + s_time_seconds[time >> 5] + timestamp->Second;
+    }
+    else
+    {
+        timestamp->Epoch = 0;
     }
 }
 
 /*
- *@brief De-initialize the FAT file system.
+ *@brief Decode one date and time of every entry of a directory array.
+ *@param array - The directory array, or NULL.
+ *@param field - The date and time to decode.
+ *@param timestamps - Receives one decoded date and time per entry.
+ *@returns Returns the number of entries decoded.
+ */
+uint32_t fatfs_decode_timestamps(const DirArray *array, FATFS_TIMESTAMP_FIELD field, fatfs_timestamp_struct_t *timestamps)
+{
+    uint32_t count = (NULL != array) ? array->count : 0;
+    /* The number of entries decoded */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    for (i = 0; i < count; i++)
+    {
+        if (FATFS_TIMESTAMP_CREATED == field)
+        {
+            fatfs_decode_timestamp(array->entries[i].Creation_Date, array->entries[i].Creation_Time, &timestamps[i]);
+        }
+        else
+        {
+            fatfs_decode_timestamp(array->entries[i].Last_Write_Date, array->entries[i].Last_Write_Time, &timestamps[i]);
+        }
+    }
+
+    return count;
+}
+
+/*
+ *@brief Store every node of the tree index in columns.
  *@param None.
- *@returns No return value.
+ *@returns Returns the columns, or NULL if there is no tree index or memory allocation failed.
  */
-void fatfs_de_init(void)
+fatfs_dir_columns_struct_t *fatfs_get_index_columns(void)
 {
-    /* Deallocate the FAT table */
-    free(s_fat_table);
-    /* De-initialize the KMC */
-    kmc_de_init();
+    fatfs_dir_columns_struct_t *columns = NULL;
+    /* The columns returned to the caller */
+    fatfs_entry_view_struct_t node_view;
+    /* The view of a node */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    /* The number of rows is known, so the columns never grow */
+    if (0 != s_tree_node_count)
+    {
+        columns = dir_columns_allocate(s_tree_node_count);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (NULL != columns)
+    {
+        node_view.Raw = NULL;
+        node_view.Long_name = NULL;
+        for (i = 0; i < s_tree_node_count; i++)
+        {
+            node_view.Entry = &s_tree_nodes[i].Entry;
+            dir_columns_append(&columns, &node_view);
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return columns;
+}
+
+/*
+ *@brief Get the tree index built at mount time.
+ *@param node_count - Receives the number of nodes.
+ *@returns Returns the node array, or NULL if the volume was not mounted with FATFS_MOUNT_TREE_INDEX.
+ */
+const fatfs_tree_node_struct_t *fatfs_get_tree_index(uint32_t *node_count)
+{
+    *node_count = s_tree_node_count;
+
+    return s_tree_nodes;
 }
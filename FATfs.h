@@ -28,25 +28,67 @@
  * Definitions
  ******************************************************************************/
 
+/*
+ * @brief Enumeration of the supported FAT types.
+ * @details The FAT type is determined from the number of clusters in the data area, as described in the BPB specification.
+ *                exFAT volumes are recognized by the file system name in the boot sector instead.
+ *                It selects the width of a FAT entry (12, 16 or 28 bits) and whether the root directory is a fixed region or a cluster chain.
+ */
+typedef enum FATFS_TYPE
+{
+    FATFS_TYPE_FAT12, /* 12-bit FAT entries, fixed root directory region. */
+    FATFS_TYPE_FAT16, /* 16-bit FAT entries, fixed root directory region. */
+    FATFS_TYPE_FAT32, /* 28-bit FAT entries, root directory stored in a cluster chain. */
+    FATFS_TYPE_EXFAT, /* 32-bit FAT entries, allocation bitmap and contiguous (NoFatChain) streams. */
+} FATFS_TYPE;
+
 /*
  * @brief Structure representing the boot sector of a FAT file system.
  * @details This structure contains various parameters of the boot sector such as bytes per sector, sectors per cluster, number of FATs,
  *                maximum number of root directory entries, total sector count, and sectors per FAT.
+ *                The FAT32 extended fields and the derived cluster count and FAT type are filled in when the boot sector is parsed.
  */
 typedef struct fatfs_bootsector_struct_t
 {
     uint16_t bytes_per_sector;                         /* The number of bytes in each sector. */
     uint16_t sectors_per_cluster;                      /* The number of sectors in each cluster. */
+    uint32_t Reserved_sector_count;                    /* The number of reserved sectors before the first FAT (the FAT offset on exFAT). */
     uint8_t Number_of_FATs;                            /* The number of File Allocation Tables (FATs). */
     uint16_t Maximum_number_of_root_directory_entries; /* The maximum number of entries in the root directory. */
-    uint16_t Total_sector_count;                       /* The total number of sectors in the file system. */
-    uint16_t Sectors_per_FAT;                          /* The number of sectors per File Allocation Table (FAT). */
+    uint32_t Total_sector_count;                       /* The total number of sectors in the file system. */
+    uint32_t Sectors_per_FAT;                          /* The number of sectors per File Allocation Table (FAT). */
+    uint32_t Root_cluster;                             /* The first cluster of the root directory (FAT32 and exFAT only). */
+    uint32_t Cluster_heap_offset;                      /* The first sector of the cluster heap (exFAT only). */
+    uint32_t Cluster_count;                            /* The number of clusters in the data area. */
+    FATFS_TYPE Fat_type;                               /* The FAT type detected from the cluster count. */
 } fatfs_bootsector_struct_t;
 
+/*
+ * @brief Packed 8.3 name of a directory entry.
+ * @details The 8 characters of the name and the 3 characters of the extension, in upper case and padded with spaces, are packed
+ *                first character in the most significant byte. Two names are equal when both integers are equal, and comparing Name
+ *                then Extension orders names like comparing the padded strings.
+ */
+typedef struct fatfs_name_key_struct_t
+{
+    uint64_t Name;      /* The 8 characters of the name. */
+    uint32_t Extension; /* The 3 characters of the extension, in the low 24 bits. */
+} fatfs_name_key_struct_t;
+
+/*
+ * @brief Compare, order and hash packed 8.3 names.
+ */
+#define FATFS_NAME_KEY_EQUAL(a, b) ((a).Name == (b).Name && (a).Extension == (b).Extension)
+#define FATFS_NAME_KEY_LESS(a, b) ((a).Name < (b).Name || ((a).Name == (b).Name && (a).Extension < (b).Extension))
+#define FATFS_NAME_KEY_HASH(key) ((uint32_t)((((key).Name * 0x9E3779B97F4A7C15ULL + (key).Extension) * 0x9E3779B97F4A7C15ULL) >> 32))
+
 /*
  * @brief Structure representing a directory entry in a FAT file system.
  * @details This structure contains various parameters of a directory entry such as file name, extension, attributes,
  *                creation time and date, last write time and date, first logical cluster, and file size in bytes.
+ *                Long_name points to storage owned by the list, array or iterator the entry was obtained from. Entries returned by
+ *                fatfs_open and fatfs_lookup share the storage of the library's directory cache, their long name stays valid until
+ *                the next call to fatfs_open, fatfs_lookup or fatfs_check_for_changes.
  */
 typedef struct fatfs_directory_entry_list_struct_t
 {
@@ -57,8 +99,10 @@ typedef struct fatfs_directory_entry_list_struct_t
     uint16_t Creation_Date;         /* The date the file was created. */
     uint16_t Last_Write_Time;       /* The last time the file was written to. */
     uint16_t Last_Write_Date;       /* The last date the file was written to. */
-    uint16_t First_Logical_Cluster; /* The first logical cluster of the file. */
+    uint32_t First_Logical_Cluster; /* The first logical cluster of the file. */
     uint64_t File_Size_in_bytes;    /* The size of the file in bytes. */
+    const char *Long_name;          /* The long file name in UTF-8, or NULL if the entry has none. */
+    fatfs_name_key_struct_t Name_key; /* The packed 8.3 name, used to compare, sort and hash names. */
 } fatfs_directory_entry_list_struct_t;
 
 /*
@@ -71,20 +115,211 @@ typedef struct DirList
     struct DirList *next;                     /* Pointer to the next node in the directory list. */
 } DirList;
 
+/*
+ * @brief Structure holding a whole directory in one allocation.
+ * @details The entries are stored contiguously after the count, so a directory is iterated by index
+ *                and freed with a single call to deallocate_Dir_Array. Long names are packed into a few large blocks owned by the array.
+ */
+typedef struct DirArray
+{
+    uint32_t count;                                /* The number of entries in the array. */
+    uint32_t capacity;                             /* The number of entries allocated. */
+    struct fatfs_name_block_struct_t *names;       /* The blocks holding the long names of the entries. */
+    fatfs_directory_entry_list_struct_t entries[]; /* The directory entries. */
+} DirArray;
+
+/*
+ * @brief Mount option: read every directory of the volume into the tree index at mount time.
+ */
+#define FATFS_MOUNT_TREE_INDEX 0x01U
+
+/*
+ * @brief Mount option: keep the tree index in a snapshot file stored beside the image (its path followed by ".snap").
+ * @details A snapshot taken from the image with the same size, modification time (to the nanosecond), inode, boot sector and FAT
+ *                is loaded instead of reading every directory; the FAT is read with one range read to check it. Otherwise the
+ *                image is read and the snapshot is written again. Implies FATFS_MOUNT_TREE_INDEX.
+ *                exFAT volumes are always read from the image.
+ */
+#define FATFS_MOUNT_SNAPSHOT 0x02U
+
+/*
+ * @brief Structure representing one entry of the volume in the tree index.
+ * @details The tree index is a flattened array built breadth first from the root directory, which is node 0.
+ *                The entries of a directory are stored next to each other, in the order of fatfs_read_dir,
+ *                from First_child to First_child + Child_count - 1. The "." and ".." entries are nodes but are not expanded.
+ */
+typedef struct fatfs_tree_node_struct_t
+{
+    fatfs_directory_entry_list_struct_t Entry; /* The directory entry, with a blank name and first cluster 0 for the root directory. */
+    uint32_t Parent;                           /* The index of the node of the directory holding the entry, 0 for the root directory. */
+    uint32_t First_child;                      /* The index of the first entry of a directory, 0 if it has none. */
+    uint32_t Child_count;                      /* The number of entries of a directory, 0 for a file. */
+} fatfs_tree_node_struct_t;
+
+/*
+ * @brief Build a FAT date, as stored in Last_Write_Date and Creation_Date, from a year, month and day.
+ */
+#define FATFS_DATE(year, month, day) ((uint16_t)((((year) - 1980) << 9) | ((month) << 5) | (day)))
+
+/*
+ * @brief Structure holding a decoded FAT date and time.
+ * @details The fields are the bit fields of the date and time as stored, out of range values included. FAT stores local time
+ *                without a time zone, so Epoch counts the seconds from 1970-01-01 00:00:00 to the stored time as if it were UTC.
+ */
+typedef struct fatfs_timestamp_struct_t
+{
+    int64_t Epoch;   /* The seconds since 1970-01-01 00:00:00, 0 for an empty date. */
+    uint16_t Year;   /* The year, 1980 to 2107. */
+    uint8_t Month;   /* The month, 1 to 12. */
+    uint8_t Day;     /* The day of the month, 1 to 31, 0 for an empty date. */
+    uint8_t Hour;    /* The hour, 0 to 23. */
+    uint8_t Minute;  /* The minute, 0 to 59. */
+    uint8_t Second;  /* The second, 0 to 58 in steps of 2. */
+} fatfs_timestamp_struct_t;
+
+/*
+ * @brief Structure describing a search of the whole volume with fatfs_find.
+ * @details An entry matches when every predicate holds. A predicate left at 0 (or NULL) is not checked.
+ */
+typedef struct fatfs_find_query_struct_t
+{
+    const char *Pattern;      /* Name pattern with '*' and '?', matched without regard to case against "NAME.EXT" or the long name. */
+    uint8_t Attributes_set;   /* Attribute bits that must all be set, for example 0x10 for directories only. */
+    uint8_t Attributes_clear; /* Attribute bits that must all be clear, for example 0x10 for files only. */
+    uint64_t Minimum_size;    /* The smallest size in bytes. */
+    uint64_t Maximum_size;    /* The largest size in bytes. */
+    uint16_t Modified_after;  /* Entries last written on this FAT date or later, see FATFS_DATE. */
+    uint16_t Modified_before; /* Entries last written on this FAT date or earlier, see FATFS_DATE. */
+} fatfs_find_query_struct_t;
+
+/*
+ * @brief Directory entries stored one field per array.
+ * @details Row i of every column describes the same entry, so a predicate reads only the column it tests. The columns live in the
+ *                same allocation as the structure and are freed with a single call to deallocate_Dir_Columns. Long names are not kept.
+ */
+typedef struct fatfs_dir_columns_struct_t
+{
+    uint32_t Count;                     /* The number of entries. */
+    uint32_t Capacity;                  /* The number of rows allocated in every column. */
+    uint64_t *Sizes;                    /* The size in bytes of every entry. */
+    fatfs_name_key_struct_t *Name_keys; /* The packed 8.3 name of every entry. */
+    uint32_t *First_clusters;           /* The first cluster of every entry. */
+    uint16_t *Modified_dates;           /* The last write date of every entry. */
+    uint16_t *Created_dates;            /* The creation date of every entry. */
+    uint8_t *Attributes;                /* The attribute byte of every entry. */
+} fatfs_dir_columns_struct_t;
+
+/*
+ * @brief Estimated recoverability of a deleted entry.
+ * @details The FAT chain of a deleted file is cleared, so recovery assumes the data is stored in consecutive clusters
+ *                from the first cluster recorded in the entry, as undelete tools do.
+ */
+typedef enum FATFS_RECOVERY
+{
+    FATFS_RECOVERY_EMPTY,   /* The entry has no data to recover. */
+    FATFS_RECOVERY_GOOD,    /* Every cluster the data needs is still free. */
+    FATFS_RECOVERY_PARTIAL, /* The first cluster is free but a later one has been allocated again. */
+    FATFS_RECOVERY_LOST,    /* The first cluster has been allocated again or is not a valid cluster. */
+} FATFS_RECOVERY;
+
+/*
+ * @brief Structure reporting one deleted entry found by fatfs_scan_deleted.
+ */
+typedef struct fatfs_deleted_entry_struct_t
+{
+    fatfs_directory_entry_list_struct_t Entry; /* The entry as stored, without long name; a deleted entry starts with 0xE5. */
+    uint32_t Directory_cluster;                /* The cluster holding the entry, 0 for the fixed root directory region. */
+    uint32_t Entry_index;                      /* The position of the entry in its cluster or in the fixed root directory region. */
+    uint8_t Orphaned;                          /* Set when the cluster is a deleted directory found by its "." and ".." entries. */
+    uint32_t Clusters_needed;                  /* The number of clusters of the data, 1 for a directory. */
+    uint32_t Clusters_free;                    /* The number of those clusters, from the first one on, that are still free. */
+    FATFS_RECOVERY Recoverability;             /* The estimated recoverability of the data. */
+} fatfs_deleted_entry_struct_t;
+
+/*
+ * @brief Structure reporting the disk usage of a directory tree with fatfs_disk_usage.
+ * @details The totals cover the directory and everything below it. Deleted entries, "." and ".." are not counted.
+ */
+typedef struct fatfs_disk_usage_struct_t
+{
+    uint64_t Logical_size;    /* The sum of the sizes of the files, in bytes. */
+    uint64_t Allocated_size;  /* The clusters of the files and directories, in bytes, including the directory itself. */
+    uint32_t File_count;      /* The number of files. */
+    uint32_t Directory_count; /* The number of subdirectories, not counting the directory itself. */
+} fatfs_disk_usage_struct_t;
+
+/*
+ * @brief Order of a sorted directory listing.
+ * @details Names are compared without regard to case. Ties are broken by name then extension, so the result does not depend
+ *                on the order of the entries on disk. The "." and ".." entries always come first.
+ */
+typedef enum FATFS_SORT_KEY
+{
+    FATFS_SORT_NAME,      /* By name, then extension. */
+    FATFS_SORT_EXTENSION, /* By extension, then name. */
+    FATFS_SORT_SIZE,      /* By size in bytes, smallest first. */
+    FATFS_SORT_MODIFIED,  /* By last write date and time, oldest first. */
+    FATFS_SORT_CREATED,   /* By creation date and time, oldest first. */
+} FATFS_SORT_KEY;
+
+/*
+ * @brief Date and time of a directory entry decoded by fatfs_decode_timestamps.
+ */
+typedef enum FATFS_TIMESTAMP_FIELD
+{
+    FATFS_TIMESTAMP_MODIFIED, /* Last_Write_Date and Last_Write_Time. */
+    FATFS_TIMESTAMP_CREATED,  /* Creation_Date and Creation_Time. */
+} FATFS_TIMESTAMP_FIELD;
+
+/*
+ * @brief Opaque state of a directory being read one entry at a time.
+ * @details Created by fatfs_opendir, advanced by fatfs_readdir and released by fatfs_closedir.
+ */
+typedef struct DirIterator DirIterator;
+
+/*
+ * @brief View of a directory entry returned by fatfs_readdir_view.
+ * @details A FAT entry is viewed in place: Raw points at its 32 bytes in the cluster buffer of the iterator, and the fatfs_view_
+ *                accessors decode only the field they are asked for. The synthesized exFAT ".." entry and exFAT entries, which are
+ *                decoded to verify their checksum, are viewed through Entry instead. The view is valid until the next call on the iterator.
+ */
+typedef struct fatfs_entry_view_struct_t
+{
+    const uint8_t *Raw;                               /* The raw short entry, NULL if the entry is viewed through Entry. */
+    const fatfs_directory_entry_list_struct_t *Entry; /* The decoded entry, NULL if the entry is viewed through Raw. */
+    const char *Long_name;                            /* The long file name in UTF-8, NULL if the entry has none. */
+} fatfs_entry_view_struct_t;
+
+/*
+ * @brief Position of a paged listing in a directory, see fatfs_read_dir_page.
+ * @details Cluster and Entry locate the first entry not read yet: the position of its cluster in the directory (one cluster worth
+ *                of sectors of the fixed root directory region on FAT12 and FAT16) and its position in that cluster.
+ */
+typedef struct fatfs_dir_cursor_struct_t
+{
+    uint32_t Directory; /* The first cluster of the directory, 0 for the root directory. */
+    uint32_t Cluster;   /* The position in the directory of the cluster holding the next entry. */
+    uint32_t Entry;     /* The position of the next entry in its cluster. */
+    uint32_t Returned;  /* The number of entries returned so far. */
+    uint8_t End;        /* Set once the end of the directory has been reached. */
+} fatfs_dir_cursor_struct_t;
+
 /*
  * @brief Structure representing a node in a cluster list.
  * @details This structure contains a pointer to the data in a cluster and a pointer to the next node in the cluster list.
+ *                A node holds one cluster, or a whole run of clusters when they were read with a single range read.
  */
 typedef struct ClusterList
 {
     uint8_t *data_in_cluster; /* Pointer to the data in a cluster. */
+    uint32_t number_of_bytes; /* The number of bytes in data_in_cluster. */
     struct ClusterList *next; /* Pointer to the next node in the cluster list. */
 } ClusterList;
 
 /*
  * @brief Enumeration of error codes.
  * @details This enumeration defines various error codes for different error scenarios such as file opening,
-                  boot sector reading, memory allocation, sector size updating, and directory reading errors. */
+                  boot sector reading, memory allocation, sector size updating, directory reading and boot sector validation errors. */
 typedef enum ERROR_CODE
 {
     ERROR_OPENING_FILE,
@@ -95,8 +330,37 @@ typedef enum ERROR_CODE
     CLUSTER_SIZE_ERROR,
     ERROR_READING_ROOT_DIRECTORY,
     ERROR_READING_SUB_DIRECTORY,
+    INVALID_BOOT_SECTOR,
 } ERROR_CODE;
 
+/*
+ * @brief Structure reporting the fragmentation of one file.
+ * @details A file is identified by the first cluster of its chain. An extent is a run of consecutive clusters,
+ *                and reading the file needs one seek per extent.
+ */
+typedef struct fatfs_file_fragmentation_struct_t
+{
+    uint32_t First_cluster;      /* The first cluster of the file. */
+    uint32_t Cluster_count;      /* The number of clusters in the chain. */
+    uint32_t Extent_count;       /* The number of runs of consecutive clusters. */
+    float Average_extent_length; /* The average extent length in clusters. */
+    uint32_t Expected_seeks;     /* The number of seeks needed to read the file sequentially. */
+} fatfs_file_fragmentation_struct_t;
+
+/*
+ * @brief Structure reporting the fragmentation of a whole volume.
+ * @details The totals cover every cluster chain recorded in the FAT.
+ */
+typedef struct fatfs_volume_fragmentation_struct_t
+{
+    uint32_t File_count;            /* The number of cluster chains. */
+    uint32_t Fragmented_file_count; /* The number of chains with more than one extent. */
+    uint32_t Cluster_count;         /* The number of clusters in all chains. */
+    uint32_t Extent_count;          /* The number of extents in all chains. */
+    float Average_extent_length;    /* The average extent length in clusters. */
+    uint32_t Expected_seeks;        /* The number of seeks needed to read every file sequentially. */
+} fatfs_volume_fragmentation_struct_t;
+
 /*
  * @brief Typedef for an error callback function.
  * @details This typedef defines a function pointer type for an error callback function that takes an error code as a parameter.
@@ -104,6 +368,25 @@ typedef enum ERROR_CODE
 
 typedef void (*ErrorCallback)(ERROR_CODE);
 
+/*
+ * @brief Typedef for a fragmentation report callback function.
+ * @details This typedef defines a function pointer type called once per file by the fragmentation analysis.
+ */
+typedef void (*FragmentationCallback)(const fatfs_file_fragmentation_struct_t *);
+
+/*
+ * @brief Typedef for a search match callback function.
+ * @details Called by fatfs_find with the matching entry, its path and the context given to fatfs_find.
+ *               It returns 1 to continue the search or 0 to stop it.
+ */
+typedef uint8_t (*FindCallback)(const fatfs_directory_entry_list_struct_t *, const char *, void *);
+
+/*
+ * @brief Typedef for a deleted entry callback function.
+ * @details Called by fatfs_scan_deleted with the report of a deleted entry and the context given to fatfs_scan_deleted.
+ */
+typedef void (*RecoveryCallback)(const fatfs_deleted_entry_struct_t *, void *);
+
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
@@ -118,24 +401,356 @@ typedef void (*ErrorCallback)(ERROR_CODE);
  */
 uint32_t fatfs_init(const char *path, ErrorCallback callback);
 
+/*
+ * @brief Initialize the FAT file system with mount options.
+ * @details This function mounts the image like fatfs_init, then applies the options. With FATFS_MOUNT_TREE_INDEX every directory of the volume
+ *               is read once, breadth first, into the tree index. fatfs_read_dir, fatfs_read_dir_array, fatfs_lookup and fatfs_open are then
+ *               served from memory without I/O, and the index is built again when fatfs_check_for_changes detects a change.
+ *               With FATFS_MOUNT_SNAPSHOT the tree index is loaded from the snapshot when it still matches the image and its FAT,
+ *               and the snapshot is written whenever the tree index is built.
+ * @param path - The path to the file system to be initialized.
+ * @param callback - The callback function for error handling.
+ * @param options - A combination of FATFS_MOUNT_ flags, 0 for none.
+ * @returns Returns the size of the cluster.
+ */
+uint32_t fatfs_init_with_options(const char *path, ErrorCallback callback, uint32_t options);
+
 /*
  * @brief Read a directory from the FAT file system.
- * @details This function reads a directory from a FAT file system. It handles both root and subdirectories,
+ * @details This function reads a directory from a FAT12, FAT16, FAT32 or exFAT file system. It handles both root and subdirectories,
  *               reading directory entries into a buffer, validating them, and adding them to a directory list.
  *               It also manages memory allocation for the buffer and handles errors by calling an error callback function.
  * @param First_Logical_Directory_of_current - The first logical directory of the current directory.
  * @returns Returns a pointer to the head of the directory list.
  */
-DirList *fatfs_read_dir(uint16_t First_Logical_Cluster_of_choice);
+DirList *fatfs_read_dir(uint32_t First_Logical_Cluster_of_choice);
+
+/*
+ * @brief Read a directory from the FAT file system into one contiguous array.
+ * @details This function decodes the same entries as fatfs_read_dir, in the same order, but stores them in a single
+ *               count-prefixed allocation instead of one node per entry. An empty directory gives an array with a count of 0.
+ *               It is built on the directory iterator, and fatfs_read_dir is built on it and copies the array into a linked list.
+ *               The clusters of the last few FAT directories read are fingerprinted with a hash of their raw bytes: when a directory
+ *               is read again, even after the image changed, the entries of the leading clusters that still hash the same are copied
+ *               instead of being decoded. The clusters are always read from the image.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @returns Returns the directory array, to be freed with deallocate_Dir_Array, or NULL if memory allocation failed.
+ */
+DirArray *fatfs_read_dir_array(uint32_t First_Logical_Cluster_of_choice);
+
+/*
+ * @brief Set a cursor to the start of a directory.
+ * @param cursor - The cursor.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @returns None.
+ */
+void fatfs_dir_cursor_init(fatfs_dir_cursor_struct_t *cursor, uint32_t First_Logical_Cluster_of_choice);
+
+/*
+ * @brief Read the next page of a directory.
+ * @details The entries are the ones of fatfs_read_dir_array, in the same order, page_size at a time. The directory is read from
+ *               the cluster the cursor points at, skipping the clusters before it through the chain in memory, and reading stops
+ *               at the last cluster the page needs, so a page costs only the clusters that cover it. A directory of the tree index
+ *               is paged from memory; exFAT directories are read whole for every page. End is set when the directory runs out,
+ *               which may take one more call returning no entry when the last page is full.
+ * @param cursor - The cursor set by fatfs_dir_cursor_init, moved past the entries read.
+ * @param page_size - The largest number of entries to read.
+ * @returns Returns the entries of the page, to be freed with deallocate_Dir_Array, or NULL if memory allocation failed.
+ */
+DirArray *fatfs_read_dir_page(fatfs_dir_cursor_struct_t *cursor, uint32_t page_size);
+
+/*
+ * @brief Sort a directory array.
+ * @details The sort key of every entry is packed into integers in one pass over the entries, then the keys are ordered with an LSD
+ *               radix sort, one byte per pass. Passes over a byte shared by every key, such as the high bytes of small sizes, are skipped,
+ *               so the cost is linear in the number of entries. Memory is allocated for the keys only.
+ * @param array - The directory array returned by fatfs_read_dir_array, or NULL.
+ * @param key - The order of the entries.
+ * @returns None.
+ */
+void fatfs_sort_dir_array(DirArray *array, FATFS_SORT_KEY key);
+
+/*
+ * @brief Read a directory into columns.
+ * @details The entries are the ones of fatfs_read_dir_array, in the same order. A directory of the tree index is read from memory,
+ *               any other directory through fatfs_readdir_view, so only the fields stored in the columns are decoded.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @returns Returns the columns, to be freed with deallocate_Dir_Columns, or NULL if memory allocation failed.
+ */
+fatfs_dir_columns_struct_t *fatfs_read_dir_columns(uint32_t First_Logical_Cluster_of_choice);
+
+/*
+ * @brief Store every node of the tree index in columns.
+ * @details Row i describes node i of the array returned by fatfs_get_tree_index, so a match can be located in the tree through
+ *               its Parent field. Row 0 is the root directory.
+ * @param None.
+ * @returns Returns the columns, to be freed with deallocate_Dir_Columns, or NULL if there is no tree index or memory allocation failed.
+ */
+fatfs_dir_columns_struct_t *fatfs_get_index_columns(void);
+
+/*
+ * @brief Select the rows of a set of columns matching a query.
+ * @details The predicates are tested one column at a time: the attribute column is scanned first into a list of rows, then the
+ *               size and date predicates that are set each narrow the list down in one pass over their column. The loops have no
+ *               data-dependent branch, so the compiler can vectorize them. The Pattern of the query is not checked.
+ * @param columns - The columns, or NULL.
+ * @param query - The predicates, as for fatfs_find.
+ * @param rows - Receives the matching rows in increasing order, room for columns->Count rows.
+ * @returns Returns the number of matching rows.
+ */
+uint32_t fatfs_select_dir_columns(const fatfs_dir_columns_struct_t *columns, const fatfs_find_query_struct_t *query, uint32_t *rows);
+
+/*
+ * @brief Sort a directory list.
+ * @details The nodes are sorted like fatfs_sort_dir_array and linked again in the new order; no entry is copied.
+ * @param head - The head of the directory list returned by fatfs_read_dir, or NULL.
+ * @param key - The order of the entries.
+ * @returns Returns the new head of the list.
+ */
+DirList *fatfs_sort_dir_list(DirList *head, FATFS_SORT_KEY key);
+
+/*
+ * @brief Open a directory for reading one entry at a time.
+ * @details The iterator reads the directory one cluster at a time, and only when fatfs_readdir needs more entries,
+ *               so a caller looking for one entry can stop as soon as it is found without reading or decoding the rest.
+ *               exFAT directories are read whole on the first call to fatfs_readdir, since an entry set may cross a cluster boundary.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @returns Returns the directory iterator, to be released with fatfs_closedir, or NULL if memory allocation failed.
+ */
+DirIterator *fatfs_opendir(uint32_t First_Logical_Cluster_of_choice);
+
+/*
+ * @brief Read the next entry of a directory.
+ * @details Entries are returned in the order of fatfs_read_dir. The returned entry, including its long name, belongs to the iterator
+ *               and is overwritten by the next call.
+ * @param iterator - The directory iterator returned by fatfs_opendir.
+ * @returns Returns a pointer to the next entry, or NULL when the directory has no more entries.
+ */
+const fatfs_directory_entry_list_struct_t *fatfs_readdir(DirIterator *iterator);
+
+/*
+ * @brief Close a directory iterator.
+ * @details The iterator can be closed at any point, before or after the last entry has been read.
+ * @param iterator - The directory iterator returned by fatfs_opendir, or NULL.
+ * @returns None. This function performs memory deallocation.
+ */
+void fatfs_closedir(DirIterator *iterator);
+
+/*
+ * @brief Read the next entry of a directory without decoding or copying it.
+ * @details The entry is found and its long name assembled as with fatfs_readdir, but the other fields stay in the cluster buffer of
+ *               the iterator and are decoded by the fatfs_view_ accessors on access. Calls to fatfs_readdir and fatfs_readdir_view
+ *               may be mixed on one iterator.
+ * @param iterator - The directory iterator returned by fatfs_opendir, or NULL.
+ * @returns Returns the view of the next entry, valid until the next call on the iterator, or NULL at the end of the directory.
+ */
+const fatfs_entry_view_struct_t *fatfs_readdir_view(DirIterator *iterator);
+
+/*
+ * @brief Get the attributes of a viewed entry.
+ * @param view - The view returned by fatfs_readdir_view.
+ * @returns Returns the attribute byte, 0x10 for a directory.
+ */
+uint8_t fatfs_view_attributes(const fatfs_entry_view_struct_t *view);
+
+/*
+ * @brief Get the first cluster of a viewed entry.
+ * @param view - The view returned by fatfs_readdir_view.
+ * @returns Returns the first cluster, with its upper 16 bits on FAT32, 0 for an empty file.
+ */
+uint32_t fatfs_view_first_cluster(const fatfs_entry_view_struct_t *view);
+
+/*
+ * @brief Get the size of a viewed entry.
+ * @param view - The view returned by fatfs_readdir_view.
+ * @returns Returns the size in bytes.
+ */
+uint64_t fatfs_view_size(const fatfs_entry_view_struct_t *view);
+
+/*
+ * @brief Decode a date and time of a viewed entry, as fatfs_decode_timestamp does.
+ * @param view - The view returned by fatfs_readdir_view.
+ * @param field - The date and time to decode.
+ * @param timestamp - Receives the decoded date and time.
+ * @returns None.
+ */
+void fatfs_view_timestamp(const fatfs_entry_view_struct_t *view, FATFS_TIMESTAMP_FIELD field, fatfs_timestamp_struct_t *timestamp);
+
+/*
+ * @brief Format the 8.3 name of a viewed entry as "NAME.EXT", without the padding spaces.
+ * @param view - The view returned by fatfs_readdir_view.
+ * @param name - Receives the name, at least 13 characters.
+ * @returns Returns the length of the name.
+ */
+uint32_t fatfs_view_short_name(const fatfs_entry_view_struct_t *view, char *name);
+
+/*
+ * @brief Find a file or directory by path.
+ * @details The path is resolved from the root directory, one component at a time. Components are separated by '/' or '\\',
+ *               are matched without regard to case against the 8.3 names or long names returned by fatfs_read_dir, and may be "." or "..".
+ *               Resolved components are kept in a per-mount dentry cache keyed by parent directory and name, so repeated lookups
+ *               under the same directories cost a hash probe instead of a directory read. Other names are found through the
+ *               directory name index described with fatfs_lookup. The cache is dropped when
+ *               fatfs_check_for_changes detects a change. An empty path or "/" gives the root directory, whose first cluster is 0.
+ * @param path - The path of the file or directory, for example "/DOCS/NESTED/DEEP.TXT".
+ * @param entry - Receives the directory entry of the file or directory.
+ * @returns Returns 1 if the path was found, 0 if it was not found or no volume is mounted.
+ */
+uint8_t fatfs_open(const char *path, fatfs_directory_entry_list_struct_t *entry);
+
+/*
+ * @brief Find a name in a directory.
+ * @details The first lookup in a directory reads it with fatfs_read_dir_array and builds an open-addressing hash index
+ *               keyed on the 11-byte 8.3 name. The listing and its index are kept for the 8 most recently used directories,
+ *               so later lookups in the same directory are a hash probe. They are dropped when fatfs_check_for_changes detects a change.
+ *               fatfs_open uses the same index when a path component is not in its dentry cache. A name that is not found as an
+ *               8.3 name is compared, without regard to the case of ASCII letters, with the long names of the cached listing.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @param name - The 8.3 name or long name to find, matched without regard to case, for example "FILE.TXT".
+ * @param entry - Receives the directory entry if it is found.
+ * @returns Returns 1 if the name was found, 0 if it was not found or no volume is mounted.
+ */
+uint8_t fatfs_lookup(uint32_t First_Logical_Cluster_of_choice, const char *name, fatfs_directory_entry_list_struct_t *entry);
 
 /*
  * @brief Read a file from the FAT file system.
  * @details This function reads a file's data into a linked list of clusters. It allocates memory for reading file data,
  *               iterates over the file's clusters, and constructs a linked list with the data until the end of the file is reached.
+ *               Each run of consecutive clusters is read with a single range read into one node, and the runs of a file read before
+ *               come from the cluster chain cache. A contiguous exFAT file is laid out without touching the FAT.
+ *               Runs longer than 64 MiB are split into several nodes, so that files of any size can be read.
  * @param First_Logical_Cluster_of_current - The starting cluster of the file.
  * @returns A pointer to the first node in the linked list of file data clusters.
  */
-ClusterList *fatfs_read_file(uint16_t First_Logical_Cluster_of_choice);
+ClusterList *fatfs_read_file(uint32_t First_Logical_Cluster_of_choice);
+
+/*
+ * @brief Get the type of the mounted FAT file system.
+ * @details This function returns the FAT type detected from the boot sector by fatfs_init.
+ * @param None.
+ * @returns The FAT type of the mounted file system.
+ */
+FATFS_TYPE fatfs_get_type(void);
+
+/*
+ * @brief Check whether a cluster is allocated.
+ * @details This function reports whether a cluster is in use, from the allocation bitmap on exFAT and from the FAT otherwise.
+ * @param cluster - The cluster number to check.
+ * @returns Returns 1 if the cluster is allocated, 0 if it is free or out of range.
+ */
+uint8_t fatfs_is_cluster_allocated(uint32_t cluster);
+
+/*
+ * @brief Analyze the fragmentation of every file on the volume.
+ * @details This function finds every cluster chain in the FAT loaded by fatfs_init (a chain starts at an allocated cluster
+ *               that no other entry points to), walks it, and reports its extents. It performs no I/O.
+ *               On exFAT only FAT chains are visible; contiguous (NoFatChain) files have a single extent by definition and are not reported.
+ * @param volume - Receives the totals for the volume.
+ * @param callback - Called once per file with its report, or NULL to compute the volume totals only.
+ * @returns Returns 1 if the analysis completed, 0 if no volume is mounted or memory allocation failed.
+ */
+uint8_t fatfs_analyze_fragmentation(fatfs_volume_fragmentation_struct_t *volume, FragmentationCallback callback);
+
+/*
+ * @brief Check whether the image changed and refresh the mounted state.
+ * @details This function asks the image watcher (inotify when the HAL is built with KMC_USE_INOTIFY) or compares the size,
+ *               modification time and inode of the image with the values recorded at the last check. On a change it reopens the image,
+ *               mounts it again if the boot sector differs, and otherwise re-reads the FAT and updates only the FAT sectors that changed.
+ *               Directory lists obtained before a change are stale and should be read again.
+ * @param None.
+ * @returns Returns 1 if the image changed since the last check, 0 otherwise.
+ */
+uint8_t fatfs_check_for_changes(void);
+
+/*
+ * @brief Get the generation of the mounted image.
+ * @details The generation starts at 0 and is incremented by fatfs_check_for_changes every time a change is detected,
+ *               so a cached result can be kept for as long as the generation it was built in is current.
+ * @param None.
+ * @returns Returns the current generation.
+ */
+uint32_t fatfs_get_generation(void);
+
+/*
+ * @brief Set the memory budget of the cluster chain cache.
+ * @details fatfs_read_dir and fatfs_read_file keep the cluster chains they follow, as runs of consecutive clusters keyed by first cluster,
+ *               so reading the same file or directory again goes straight to I/O without walking the FAT. When the cache is over budget
+ *               the least recently used chains are evicted. Chains using a FAT sector that changed are dropped by fatfs_check_for_changes.
+ *               The default budget is 64 KB.
+ * @param budget - The maximum number of bytes the cache may use, 0 to disable it.
+ * @returns None.
+ */
+void fatfs_set_chain_cache_budget(uint32_t budget);
+
+/*
+ * @brief Search the whole volume for entries matching a query.
+ * @details The directory tree is walked depth first from the root directory, and every entry is tested against the query
+ *               as soon as it is decoded, so matches are streamed to the callback while the walk goes on. When the volume was mounted
+ *               with FATFS_MOUNT_TREE_INDEX the walk reads the tree index and performs no I/O. Deleted entries, "." and ".." are never
+ *               reported, and directories deeper than 32 levels are not searched. The path given to the callback uses the 8.3 names,
+ *               for example "/DOCS/A.DOC", and can be passed to fatfs_open. The entry and the path are only valid during the call,
+ *               and the callback must not call fatfs_check_for_changes or fatfs_de_init.
+ * @param query - The predicates an entry must satisfy.
+ * @param callback - Called once per matching entry.
+ * @param context - Passed unchanged to the callback.
+ * @returns Returns the number of matches reported to the callback.
+ */
+uint32_t fatfs_find(const fatfs_find_query_struct_t *query, FindCallback callback, void *context);
+
+/*
+ * @brief Find every deleted entry of the volume.
+ * @details The root directory and the whole data area are read in one sequential pass, in large reads. A cluster is scanned as a
+ *               directory when it belongs to the chain of a directory found so far, or when it starts with the "." and ".." entries
+ *               of a directory. A free cluster with that signature is an orphaned directory: a deleted directory whose entries are all
+ *               reported. The few directory clusters that come before the entry pointing to them are read again after the pass.
+ *               Long file name entries are not reported. Only FAT12, FAT16 and FAT32 are supported.
+ * @param callback - Called once per deleted entry.
+ * @param context - Passed unchanged to the callback.
+ * @returns Returns the number of deleted entries reported, 0 if no FAT12, FAT16 or FAT32 volume is mounted.
+ */
+uint32_t fatfs_scan_deleted(RecoveryCallback callback, void *context);
+
+/*
+ * @brief Compute the disk usage of a directory tree.
+ * @details The tree is walked depth first and the totals of every directory are computed bottom up, from its files and the totals
+ *               of its subdirectories. The totals of every directory reached are remembered until fatfs_check_for_changes detects
+ *               a change, so asking again for the same directory or for any directory below it performs no I/O. The allocated size
+ *               counts whole clusters, so it includes the slack at the end of each file; on FAT12 and FAT16 the root directory counts
+ *               the fixed root directory region.
+ * @param First_Logical_Cluster - The first cluster of the directory, 0 for the root directory.
+ * @param usage - Receives the totals.
+ * @returns Returns 1 on success, 0 if no volume is mounted or memory could not be allocated.
+ */
+uint8_t fatfs_disk_usage(uint32_t First_Logical_Cluster, fatfs_disk_usage_struct_t *usage);
+
+/*
+ * @brief Decode a FAT date and time.
+ * @details The epoch seconds are looked up in two tables built on the first call: the days before the first of each month, indexed by
+ *               the year and month bits of the date, and the seconds before each minute of the day, indexed by the hour and minute bits
+ *               of the time. A month out of range counts as the nearest valid month.
+ * @param date - The date, as stored in Last_Write_Date and Creation_Date.
+ * @param time - The time, as stored in Last_Write_Time and Creation_Time.
+ * @param timestamp - Receives the decoded date and time.
+ * @returns None.
+ */
+void fatfs_decode_timestamp(uint16_t date, uint16_t time, fatfs_timestamp_struct_t *timestamp);
+
+/*
+ * @brief Decode one date and time of every entry of a directory array.
+ * @param array - The directory array returned by fatfs_read_dir_array, or NULL.
+ * @param field - The date and time to decode.
+ * @param timestamps - Receives one decoded date and time per entry, in the order of the entries.
+ * @returns Returns the number of entries decoded.
+ */
+uint32_t fatfs_decode_timestamps(const DirArray *array, FATFS_TIMESTAMP_FIELD field, fatfs_timestamp_struct_t *timestamps);
+
+/*
+ * @brief Get the tree index built at mount time.
+ * @details The array belongs to the library and stays valid until the next change is detected or the file system is de-initialized.
+ * @param node_count - Receives the number of nodes, 0 if there is no tree index.
+ * @returns Returns the node array, or NULL if the volume was not mounted with FATFS_MOUNT_TREE_INDEX or the index could not be built.
+ */
+const fatfs_tree_node_struct_t *fatfs_get_tree_index(uint32_t *node_count);
 
 /*
  * @brief Deallocate a directory list.
@@ -145,6 +760,22 @@ ClusterList *fatfs_read_file(uint16_t First_Logical_Cluster_of_choice);
  */
 void deallocate_Dir_List(DirList *head);
 
+/*
+ * @brief Deallocate a directory array.
+ * @details The entries live in the same allocation as the array, and their long names in its name arena; both are released together.
+ * @param array - The directory array returned by fatfs_read_dir_array, or NULL.
+ * @returns None. This function performs memory deallocation.
+ */
+void deallocate_Dir_Array(DirArray *array);
+
+/*
+ * @brief Deallocate directory columns.
+ * @details The columns live in the same allocation as the structure, so this is a single free.
+ * @param columns - The columns returned by fatfs_read_dir_columns or fatfs_get_index_columns, or NULL.
+ * @returns None. This function performs memory deallocation.
+ */
+void deallocate_Dir_Columns(fatfs_dir_columns_struct_t *columns);
+
 /*
  * @brief Deallocate a cluster list.
  * @details This function frees the memory allocated for a linked list of clusters, including the data within each cluster.
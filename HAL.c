@@ -2,7 +2,8 @@
  * @file: HAL.c
  * @brief Main Program File
  * @Description: This program is designed to interact with the KMC system. It includes functions to initialize the KMC system with a specific file path,
- *               update the sector size for KMC, read a sector from KMC, read multiple sectors from KMC, and de-initialize the KMC system. The program handles errors
+ *               update the sector size for KMC, read a sector from KMC, read multiple sectors from KMC, detect changes to the image, read and replace files stored
+ *               beside the image, and de-initialize the KMC system. The program handles errors
  *               by checking the success of file opening and sector size updating operations. It manages memory allocation for buffers and ensures that any open file
  *               is properly closed to prevent data loss or corruption.
  *
@@ -15,10 +16,29 @@
 /*******************************************************************************
  * Includes
  ******************************************************************************/
+/* 64-bit file offsets, so that images larger than 4 GiB can be read on 32-bit systems */
+#define _FILE_OFFSET_BITS 64
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
 #include "HAL.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+#if defined(KMC_USE_INOTIFY)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+
+#if defined(KMC_USE_INOTIFY)
+#define KMC_INOTIFY_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF) /* Events that may change the image */
+#endif
 /*******************************************************************************
  * Variables
  ******************************************************************************/
@@ -29,6 +49,17 @@ static FILE *s_fptr = NULL;
 static uint16_t s_sectorSize = 0;
 /* Contains sector size*/
 
+static char *s_path = NULL;
+/* Copy of the path of the image, used to stat and reopen it */
+
+#if defined(KMC_USE_INOTIFY)
+static int s_inotifyFd = -1;
+/* The inotify instance, -1 if it could not be created */
+
+static int s_inotifyWatch = -1;
+/* The watch on the image, -1 if there is none */
+#endif
+
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
@@ -36,6 +67,36 @@ static uint16_t s_sectorSize = 0;
  * Code
  ******************************************************************************/
 
+/*
+ *@brief Set the file position of the image to a 64-bit byte offset.
+ *@param offset - The byte offset from the start of the image.
+ *@returns Returns 0 on success, non-zero otherwise.
+ */
+static int kmc_seek(uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(s_fptr, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(s_fptr, (off_t)offset, SEEK_SET);
+#endif
+}
+
+/*
+ *@brief Replace a file by another one, as rename does on POSIX systems.
+ *@param from - The path of the file that takes the place of the other one.
+ *@param to - The path of the file to be replaced, which may not exist.
+ *@returns Returns 0 on success, non-zero otherwise.
+ */
+static int kmc_replace_file(const char *from, const char *to)
+{
+#if defined(_WIN32)
+    /* rename fails on Windows when the destination exists */
+    return (0 != MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING)) ? 0 : 1;
+#else
+    return rename(from, to);
+#endif
+}
+
 /*
  *@brief Initialize KMC with a specific file path.
  *@param path - Path to the file to be opened.
@@ -51,15 +112,40 @@ uint8_t kmc_init(const char *path)
     /* Set the default sector size */
     s_sectorSize = KMC_DEFAULT_SECTOR_SIZE;
 
+    /* Keep a copy of the path to stat and reopen the image later */
+    s_path = (char *)malloc(strlen(path) + 1);
+
     /* Check if the file was opened successfully */
-    if (NULL == s_fptr)
+    if (NULL == s_fptr || NULL == s_path)
     {
+        /* Release whichever of the file and the path copy was obtained, so that nothing is left open */
+        if (NULL != s_fptr)
+        {
+            fclose(s_fptr);
+            s_fptr = NULL;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+        free(s_path);
+        s_path = NULL;
+
         /* If the file could not be opened, set the result to 0 (failure) */
         result = 0;
     }
     else
     {
-        /* If the file was opened successfully, do nothing */
+        strcpy(s_path, path);
+
+#if defined(KMC_USE_INOTIFY)
+        /* Watch the image, change detection falls back to stat if this fails */
+        s_inotifyFd = inotify_init1(IN_NONBLOCK);
+        if (0 <= s_inotifyFd)
+        {
+            s_inotifyWatch = inotify_add_watch(s_inotifyFd, s_path, KMC_INOTIFY_MASK);
+        }
+#endif
     }
 
     /* Return the result */
@@ -94,39 +180,49 @@ uint8_t kmc_update_sector_size(uint16_t sector_size)
 
 /*
  *@brief Read a sector from KMC.
- *@param index - The index of the sector to be read.
+ *@param index - The byte offset of the sector to be read.
  *@param buff - The buffer where the read data will be stored.
  *@returns Returns the number of bytes read.
  */
-int32_t kmc_read_sector(uint32_t index, uint8_t *buff)
+uint32_t kmc_read_sector(uint64_t index, uint8_t *buff)
 {
-    int32_t number_of_bytes_read = 0;
+    uint32_t number_of_bytes_read = 0;
     /* Variable to store the number of bytes read */
 
-    /* Set the file position to the specified index */
-    fseek(s_fptr, index, SEEK_SET);
-    /* Read data from the file into the buffer */
-    number_of_bytes_read = fread(buff, sizeof(uint8_t), s_sectorSize, s_fptr);
+    /* Set the file position to the specified index, and read data from the file into the buffer */
+    if (0 == kmc_seek(index))
+    {
+        number_of_bytes_read = (uint32_t)fread(buff, sizeof(uint8_t), s_sectorSize, s_fptr);
+    }
+    else
+    {
+        /* Do nothing */
+    }
 
     return number_of_bytes_read;
 }
 
 /*
  *@brief Read multiple sectors from KMC.
- *@param index - The index of the first sector to be read.
+ *@param index - The byte offset of the first sector to be read.
  *@param num - The number of sectors to be read.
  *@param buff - The buffer where the read data will be stored.
  *@returns Returns the number of bytes read.
  */
-int32_t kmc_read_multi_sector(uint32_t index, uint32_t num, uint8_t *buff)
+uint64_t kmc_read_multi_sector(uint64_t index, uint32_t num, uint8_t *buff)
 {
-    int32_t number_of_bytes_read = 0;
+    uint64_t number_of_bytes_read = 0;
     /* Variable to store the number of bytes read */
 
-    /* Set the file position to the specified index */
-    fseek(s_fptr, index, SEEK_SET);
-    /* Read data from the file into the buffer */
-    number_of_bytes_read = fread(buff, sizeof(uint8_t), s_sectorSize * num, s_fptr);
+    /* Set the file position to the specified index, and read data from the file into the buffer */
+    if (0 == kmc_seek(index))
+    {
+        number_of_bytes_read = fread(buff, sizeof(uint8_t), (size_t)s_sectorSize * num, s_fptr);
+    }
+    else
+    {
+        /* Do nothing */
+    }
 
     return number_of_bytes_read;
 }
@@ -139,5 +235,331 @@ int32_t kmc_read_multi_sector(uint32_t index, uint32_t num, uint8_t *buff)
 void kmc_de_init(void)
 {
     /* Close the file */
-    fclose(s_fptr);
+    if (NULL != s_fptr)
+    {
+        fclose(s_fptr);
+        s_fptr = NULL;
+    }
+
+    /* Release the path */
+    free(s_path);
+    s_path = NULL;
+
+#if defined(KMC_USE_INOTIFY)
+    /* Close the inotify instance, which also removes the watch */
+    if (0 <= s_inotifyFd)
+    {
+        close(s_inotifyFd);
+    }
+    s_inotifyFd = -1;
+    s_inotifyWatch = -1;
+#endif
+}
+
+/*
+ *@brief Get the stamp of the image file.
+ *@param stamp - Receives the size, modification time with nanoseconds and inode number of the image.
+ *@returns Returns 1 if the stamp was read, 0 otherwise.
+ */
+uint8_t kmc_get_image_stamp(kmc_image_stamp_struct_t *stamp)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (failure) */
+    struct stat status;
+    /* The status of the image reported by stat */
+
+    /* Check that an image was opened and that it still exists */
+    if (NULL != s_path && 0 == stat(s_path, &status))
+    {
+        stamp->size = (uint64_t)status.st_size;
+        stamp->mtime = (int64_t)status.st_mtime;
+#if defined(__APPLE__)
+        stamp->mtime_nsec = (int64_t)status.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+        stamp->mtime_nsec = 0;
+#else
+        stamp->mtime_nsec = (int64_t)status.st_mtim.tv_nsec;
+#endif
+        stamp->inode = (uint64_t)status.st_ino;
+        result = 1;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return result;
+}
+
+/*
+ *@brief Reopen the image file.
+ *@param None.
+ *@returns Returns 1 if the file was reopened successfully, 0 otherwise.
+ */
+uint8_t kmc_reopen(void)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (failure) */
+    FILE *fptr = NULL;
+    /* The newly opened file */
+
+    /* Open the image again by path before closing the old handle, so a failure keeps the old file */
+    if (NULL != s_path)
+    {
+        fptr = fopen(s_path, "rb");
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Check if the file was opened successfully */
+    if (NULL != fptr)
+    {
+        fclose(s_fptr);
+        s_fptr = fptr;
+        result = 1;
+
+#if defined(KMC_USE_INOTIFY)
+        /* Move the watch to the file now found at the path */
+        if (0 <= s_inotifyFd)
+        {
+            if (0 <= s_inotifyWatch)
+            {
+                inotify_rm_watch(s_inotifyFd, s_inotifyWatch);
+            }
+            s_inotifyWatch = inotify_add_watch(s_inotifyFd, s_path, KMC_INOTIFY_MASK);
+        }
+#endif
+    }
+    else
+    {
+#if defined(KMC_USE_INOTIFY)
+        /* The watch may be on a file that is no longer at the path, so changes are found by stat until a reopen succeeds */
+        if (0 <= s_inotifyFd && 0 <= s_inotifyWatch)
+        {
+            inotify_rm_watch(s_inotifyFd, s_inotifyWatch);
+            s_inotifyWatch = -1;
+        }
+#endif
+    }
+
+    return result;
+}
+
+/*
+ *@brief Poll for changes to the image file.
+ *@param None.
+ *@returns Returns KMC_CHANGE_NONE, KMC_CHANGE_UNKNOWN or KMC_CHANGE_DETECTED.
+ */
+uint8_t kmc_poll_changes(void)
+{
+    uint8_t result = KMC_CHANGE_UNKNOWN;
+    /* Default result is unknown, the caller compares stamps */
+
+#if defined(KMC_USE_INOTIFY)
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    /* Buffer for the pending inotify events */
+    const struct inotify_event *event = NULL;
+    /* The event being examined */
+    ssize_t length = 0;
+    /* The number of bytes of events read */
+    ssize_t offset = 0;
+    /* Offset of the event being examined */
+
+    /* Only a live watch can tell whether the image changed */
+    if (0 <= s_inotifyFd && 0 <= s_inotifyWatch)
+    {
+        result = KMC_CHANGE_NONE;
+
+        /* Drain every pending event, any event of the current watch means the image changed */
+        length = read(s_inotifyFd, events, sizeof(events));
+        while (0 < length)
+        {
+            for (offset = 0; offset < length; offset += (ssize_t)(sizeof(struct inotify_event) + event->len))
+            {
+                /* Events of a watch removed by kmc_reopen are ignored, but after an overflow events may have been lost */
+                event = (const struct inotify_event *)&events[offset];
+                if (s_inotifyWatch == event->wd || 0 != (event->mask & IN_Q_OVERFLOW))
+                {
+                    result = KMC_CHANGE_DETECTED;
+                }
+            }
+            length = read(s_inotifyFd, events, sizeof(events));
+        }
+    }
+#endif
+
+    return result;
+}
+
+/*
+ *@brief Build the path of a file stored beside the image.
+ *@param suffix - The suffix appended to the path of the image.
+ *@returns Returns the allocated path, or NULL if no image is open or the allocation failed.
+ */
+static char *kmc_side_path(const char *suffix)
+{
+    char *side_path = NULL;
+    /* The path of the image followed by the suffix */
+
+    if (NULL != s_path)
+    {
+        side_path = (char *)malloc(strlen(s_path) + strlen(suffix) + 1);
+        if (NULL != side_path)
+        {
+            strcpy(side_path, s_path);
+            strcat(side_path, suffix);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return side_path;
+}
+
+/*
+ *@brief Read a whole file stored beside the image.
+ *@param suffix - The suffix appended to the path of the image.
+ *@param size - Receives the number of bytes read.
+ *@returns Returns the allocated contents of the file, or NULL if it could not be read.
+ */
+uint8_t *kmc_load_side_file(const char *suffix, uint32_t *size)
+{
+    uint8_t *buff = NULL;
+    /* The contents of the file */
+    char *side_path = kmc_side_path(suffix);
+    /* The path of the file */
+    FILE *fptr = NULL;
+    /* The opened file */
+    long length = 0;
+    /* The length of the file */
+
+    *size = 0;
+    if (NULL != side_path)
+    {
+        fptr = fopen(side_path, "rb");
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* The file is read with a single call into a single allocation */
+    if (NULL != fptr)
+    {
+        if (0 == fseek(fptr, 0, SEEK_END))
+        {
+            length = ftell(fptr);
+        }
+        else
+        {
+            length = -1;
+        }
+
+        if (0 < length && 0 == fseek(fptr, 0, SEEK_SET))
+        {
+            buff = (uint8_t *)malloc((size_t)length);
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (NULL != buff && (size_t)length == fread(buff, 1, (size_t)length, fptr))
+        {
+            *size = (uint32_t)length;
+        }
+        else
+        {
+            free(buff);
+            buff = NULL;
+        }
+        fclose(fptr);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    free(side_path);
+
+    return buff;
+}
+
+/*
+ *@brief Replace a file stored beside the image.
+ *@param suffix - The suffix appended to the path of the image.
+ *@param buff - The new contents of the file.
+ *@param size - The number of bytes of buff.
+ *@returns Returns 1 if the file was written, 0 otherwise.
+ */
+uint8_t kmc_store_side_file(const char *suffix, const uint8_t *buff, uint32_t size)
+{
+    uint8_t result = 0;
+    /* Default result is 0 (failure) */
+    char *side_path = kmc_side_path(suffix);
+    /* The path of the file */
+    char *temporary_path = NULL;
+    /* The path the file is written to before it replaces the old one */
+    FILE *fptr = NULL;
+    /* The opened temporary file */
+
+    if (NULL != side_path)
+    {
+        temporary_path = (char *)malloc(strlen(side_path) + sizeof(".tmp"));
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    if (NULL != temporary_path)
+    {
+        strcpy(temporary_path, side_path);
+        strcat(temporary_path, ".tmp");
+        fptr = fopen(temporary_path, "wb");
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    /* Readers see either the old file or the complete new one, never a partial write */
+    if (NULL != fptr)
+    {
+        if (size == fwrite(buff, 1, size, fptr))
+        {
+            result = 1;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+
+        if (0 != fclose(fptr) || 0 == result || 0 != kmc_replace_file(temporary_path, side_path))
+        {
+            remove(temporary_path);
+            result = 0;
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    free(temporary_path);
+    free(side_path);
+
+    return result;
 }
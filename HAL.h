@@ -4,7 +4,7 @@
  * @details This header file contains the function prototypes and type definitions used in the KMC system program.
  *               It includes function prototypes for initializing the KMC system with a specific file path, updating the sector size for KMC,
  *               reading a sector from KMC, reading multiple sectors from KMC, and de-initializing the KMC system.
- *               The file also defines the default sector size for the KMC system.
+ *               The file also defines the default sector size for the KMC system, and the functions used to detect that the image changed.
  *
  * @author: Nguyen Dang Nhu Tri
  * @version: 1.0
@@ -29,6 +29,27 @@
 
 #define KMC_DEFAULT_SECTOR_SIZE 512 /* Default size of sector */
 
+/*
+ * Define KMC_USE_INOTIFY (Linux only) to watch the image with inotify. kmc_poll_changes can then report
+ * whether the image changed without calling stat.
+ */
+#define KMC_CHANGE_NONE 0     /* The image is known to be unchanged since the last poll */
+#define KMC_CHANGE_UNKNOWN 1  /* No watcher is available, the caller must compare image stamps */
+#define KMC_CHANGE_DETECTED 2 /* The watcher saw the image being modified or replaced */
+
+/*
+ * @brief Structure identifying one version of the image file.
+ * @details Two stamps that differ mean the image was modified or replaced. The inode number changes when the image
+ *                is replaced by a new file (it is 0 on systems that do not report one).
+ */
+typedef struct kmc_image_stamp_struct_t
+{
+    uint64_t size;      /* The size of the image in bytes. */
+    int64_t mtime;      /* The last modification time of the image, in seconds. */
+    int64_t mtime_nsec; /* The nanoseconds of the last modification time, 0 on systems that do not report them. */
+    uint64_t inode;     /* The inode number of the image. */
+} kmc_image_stamp_struct_t;
+
 /*******************************************************************************
  * Variables
  ******************************************************************************/
@@ -64,11 +85,11 @@ uint8_t kmc_update_sector_size(uint16_t sector_size);
  *               It takes an index representing the sector number and a buffer to store the read data.
  *               The function sets the file pointer to the start of the specified sector and reads data up to the size of the sector into the buffer.
  *               The number of bytes successfully read is then returned.
- * @param index - The index of the sector to be read. It determines the starting point for the read operation within the file.
+ * @param index - The byte offset of the sector to be read, 64 bits wide so that images larger than 4 GiB can be read.
  * @param buff - A pointer to a buffer where the read data will be stored. It must be large enough to hold the data from one sector.
  * @returns Returns the number of bytes read from the sector. This value can be used to determine if the read operation was successful and how much data was retrieved.
  */
-int32_t kmc_read_sector(uint32_t index, uint8_t *buff);
+uint32_t kmc_read_sector(uint64_t index, uint8_t *buff);
 
 /*
  * @brief Read multiple sectors from KMC.
@@ -76,12 +97,12 @@ int32_t kmc_read_sector(uint32_t index, uint8_t *buff);
  *               It sets the file pointer to the beginning of the first sector to be read and then reads data sequentially
  *               from the file into the provided buffer. The total number of bytes read across all sectors is calculated
  *               and returned, which reflects the amount of data successfully retrieved from the file.
- * @param index - The index of the first sector to be read. This is the starting point for the read operation.
+ * @param index - The byte offset of the first sector to be read, 64 bits wide so that images larger than 4 GiB can be read.
  * @param num - The number of sectors to be read. This determines how many sectors' worth of data will be read into the buffer.
  * @param buff - A pointer to a buffer where the read data will be stored. The buffer should be large enough to hold the data from the specified number of sectors.
  * @returns Returns the number of bytes read, which indicates the total amount of data retrieved from the specified sectors.
  */
-int32_t kmc_read_multi_sector(uint32_t index, uint32_t num, uint8_t *buff);
+uint64_t kmc_read_multi_sector(uint64_t index, uint32_t num, uint8_t *buff);
 
 /*
  * @brief De-initialize KMC.
@@ -92,4 +113,55 @@ int32_t kmc_read_multi_sector(uint32_t index, uint32_t num, uint8_t *buff);
  * @returns No return value. This function performs a cleanup task and does not return any value.
  */
 void kmc_de_init(void);
+
+/*
+ * @brief Get the stamp of the image file.
+ * @details This function reads the size, modification time (with nanoseconds) and inode number of the image with stat,
+ *               so that two writes within the same second are told apart.
+ *               It does not read the image itself, so it is cheap enough to call before every request.
+ * @param stamp - A pointer to the structure that receives the stamp.
+ * @returns Returns 1 if the stamp was read, 0 if the image cannot be found.
+ */
+uint8_t kmc_get_image_stamp(kmc_image_stamp_struct_t *stamp);
+
+/*
+ * @brief Reopen the image file.
+ * @details This function closes and reopens the image by path, so that reads see a file that replaced the old one.
+ *               The sector size is kept. When KMC_USE_INOTIFY is defined, the watch is moved to the new file; if the file
+ *               cannot be opened, the old handle is kept and the watch is removed, so that kmc_poll_changes reports
+ *               KMC_CHANGE_UNKNOWN until a reopen succeeds.
+ * @param None.
+ * @returns Returns 1 if the file was reopened successfully, 0 otherwise.
+ */
+uint8_t kmc_reopen(void);
+
+/*
+ * @brief Poll for changes to the image file.
+ * @details When KMC_USE_INOTIFY is defined, this function drains the pending inotify events of the image and reports
+ *               whether there were any. Without inotify it cannot know, and always reports KMC_CHANGE_UNKNOWN.
+ * @param None.
+ * @returns Returns KMC_CHANGE_NONE, KMC_CHANGE_UNKNOWN or KMC_CHANGE_DETECTED.
+ */
+uint8_t kmc_poll_changes(void);
+
+/*
+ * @brief Read a whole file stored beside the image.
+ * @details The path of the file is the path of the image followed by suffix. The file is read with a single call
+ *               into a single allocation, which the caller releases with free.
+ * @param suffix - The suffix appended to the path of the image, for example ".snap".
+ * @param size - Receives the number of bytes read, 0 on failure.
+ * @returns Returns the contents of the file, or NULL if it does not exist or could not be read.
+ */
+uint8_t *kmc_load_side_file(const char *suffix, uint32_t *size);
+
+/*
+ * @brief Replace a file stored beside the image.
+ * @details The contents are written to a temporary file which is then renamed over the old file,
+ *               so a reader never sees a partially written file.
+ * @param suffix - The suffix appended to the path of the image, for example ".snap".
+ * @param buff - The new contents of the file.
+ * @param size - The number of bytes of buff.
+ * @returns Returns 1 if the file was written, 0 otherwise.
+ */
+uint8_t kmc_store_side_file(const char *suffix, const uint8_t *buff, uint32_t size);
 #endif /*HAL_H*/
@@ -16,10 +16,24 @@
 /*******************************************************************************
  * Includes
  ******************************************************************************/
+#include <ctype.h>
 #include "FATfs.h"
 /*******************************************************************************
  * Definitions
  ******************************************************************************/
+#define NAVIGATION_CACHE_SLOTS 16U /* Number of directory listings kept while the user browses */
+#define NAVIGATION_CACHE_BUDGET (256U * 1024U) /* Memory budget of the kept listings in bytes */
+
+/*
+ * @brief Structure holding one directory listing kept by the navigation cache.
+ */
+typedef struct navigation_cache_struct_t
+{
+    DirList *Listing;       /* The listing of the directory, NULL if the slot is empty. */
+    uint32_t First_cluster; /* The first cluster of the directory, 0 for the root directory. */
+    uint32_t Size;          /* The number of bytes the listing uses. */
+    uint32_t Last_used;     /* The value of the use clock when the listing was last shown. */
+} navigation_cache_struct_t;
 /*******************************************************************************
  * Variables
  ******************************************************************************/
@@ -28,28 +42,132 @@ static uint8_t exit_program = 0;
 /* A flag to indicate if the program should exit. 0 means the program continues, 1 means the program should exit. */
 
 static uint16_t serial_number = 1;
-/* A counter for the serial number of directory entries. */
+/* The number of options of the directory shown plus one, the first number that is not a valid option. */
+
+static DirList **option_table = NULL;
+/* The entry of each option: option_table[n] is the entry of option n, option_table[0] the ".." entry or NULL in the root directory. */
+
+static uint32_t option_table_capacity = 0;
+/* The number of options option_table can hold. */
 
 static DirList *head_DirList = NULL;
 /* A pointer to the head of the directory list. */
 
+static uint8_t sort_enabled = 0;
+/* A flag to indicate if listings are sorted. 0 means the entries are shown in the order they are stored on disk. */
+
+static FATFS_SORT_KEY sort_key = FATFS_SORT_NAME;
+/* The order of the listings when they are sorted. */
+
+static uint8_t sort_requested = 0;
+/* A flag set when the user chose a new order, in which case the listing is shown again and no entry is chosen. */
+
+static navigation_cache_struct_t navigation_cache[NAVIGATION_CACHE_SLOTS];
+/* The listings of the directories visited recently, so that going back to them does not read them again. */
+
+static uint32_t navigation_cache_size = 0;
+/* The number of bytes used by the listings of the navigation cache. */
+
+static uint32_t navigation_clock = 0;
+/* A counter incremented each time a listing is shown, to find the least recently used one. */
+
 /*******************************************************************************
  * Prototypes
  ******************************************************************************/
+void print_error(ERROR_CODE err);
 
 /*******************************************************************************
  * Code
  ******************************************************************************/
+/*
+ * @brief Build the entry table of a directory list.
+ * @details This function numbers the entries the user can choose, in list order, skipping the "." and ".." entries.
+ *               The ".." entry is recorded as option 0, so choosing an option is a single table access and serial_number is set
+ *               to the number of options plus one.
+ * @param head - The head of the directory list.
+ * @returns None.
+ */
+void build_option_table(DirList *head)
+{
+    DirList *node = NULL;
+    /* A node of the directory list */
+    DirList **grown = NULL;
+    /* The table after it has grown */
+    uint32_t count = 1;
+    /* The number of slots needed, with option 0 */
+
+    for (node = head; NULL != node; node = node->next)
+    {
+        count++;
+    }
+
+    /* The table only grows, so browsing does not allocate once the largest directory has been shown */
+    if (count > option_table_capacity)
+    {
+        grown = (DirList **)realloc(option_table, count * sizeof(DirList *));
+        if (NULL != grown)
+        {
+            option_table = grown;
+            option_table_capacity = count;
+        }
+        else
+        {
+            print_error(DYNAMIC_ALLOCATON_ERROR);
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    serial_number = 1;
+    if (NULL != option_table)
+    {
+        option_table[0] = NULL;
+        for (node = head; NULL != node && serial_number < option_table_capacity && UINT16_MAX > serial_number; node = node->next)
+        {
+            /* The ".." entry is option 0, the "." entry is never an option */
+            if ('.' == node->data.File_name[0])
+            {
+                if (NULL == option_table[0])
+                {
+                    option_table[0] = node;
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+            else
+            {
+                option_table[serial_number] = node;
+                serial_number++;
+            }
+        }
+    }
+    else
+    {
+        /* Do nothing */
+    }
+}
+
 /*
  * @brief Print a directory list.
  * @details This function prints the contents of a directory list, including file and folder names, types, modification and creation dates, and sizes. It formats the output as a table and handles empty directories and hidden files.
- * @param temp_DirList - The head of the directory list to be printed.
+ *               The entries are printed from the entry table built by build_option_table, numbered by their option.
+ * @param head - The head of the directory list to be printed.
  * @returns None. This function outputs the directory list to the console.
  */
-void print_Dir_List(DirList *temp_DirList)
+void print_Dir_List(DirList *head)
 {
     /* Variable to store the bit that checks if a file or directory */
     uint8_t bit_checks_file_or_directory = 0;
+    /* The entry being printed */
+    DirList *temp_DirList = NULL;
+    /* Loop counter over the options */
+    uint16_t option = 0;
+    /* The date and time being printed */
+    fatfs_timestamp_struct_t timestamp;
 
     printf("\n\t+-----------------------------------------------------------------------------------------------------------+\n");
     printf("\t|                                               MY FLOPPY DISK                                              |\n");
@@ -59,116 +177,106 @@ void print_Dir_List(DirList *temp_DirList)
     printf("\t| Option |         Name         |    Type    |     Date modified     |     Date created      |     Size     | \n");
     printf("\t+--------+----------------------+------------+-----------------------+-----------------------+--------------+\n");
 
-    /* Loop through each node in the directory list */
-    while (NULL != temp_DirList)
+    /* Loop through each option of the entry table */
+    for (option = 1; option < serial_number; option++)
     {
-        /* Check if the directory is root directory */
-        if ('.' != temp_DirList->data.File_name[0])
-        {
-            /* Print the serial number and the file name and extension of the directory */
-            printf("\t|%4d.   |", serial_number);
-            printf("%*s", 5, "");
-            printf("%s %s", temp_DirList->data.File_name, temp_DirList->data.Extension);
-            printf("%*s|", 5, "");
+        temp_DirList = option_table[option];
+
+        /* Print the serial number and the file name and extension of the directory */
+        printf("\t|%4d.   |", option);
+        printf("%*s", 5, "");
+        printf("%s %s", temp_DirList->data.File_name, temp_DirList->data.Extension);
+        printf("%*s|", 5, "");
 
-            /* Get the bit that checks is a file or directory */
-            bit_checks_file_or_directory = (temp_DirList->data.Attributes >> 4) & 1;
+        /* Get the bit that checks is a file or directory */
+        bit_checks_file_or_directory = (temp_DirList->data.Attributes >> 4) & 1;
 
-            /* if the directory is a file */
-            if (0 == bit_checks_file_or_directory)
+        /* if the directory is a file */
+        if (0 == bit_checks_file_or_directory)
+        {
+            printf("   File     |");
+        }
+        /* if the directory is a Folder */
+        else
+        {
+            printf("   Folder   |");
+        }
+
+        /* Check if the last write date of the directory is not empty */
+        fatfs_decode_timestamp(temp_DirList->data.Last_Write_Date, temp_DirList->data.Last_Write_Time, &timestamp);
+        if (0 != timestamp.Day)
+        {
+            /* Print the last write time and date of the directory */
+            if (12 < timestamp.Hour)
             {
-                printf("   File     |");
+                printf(" %.2d:%.2d PM ", timestamp.Hour, timestamp.Minute);
             }
-            /* if the directory is a Folder */
             else
             {
-                printf("   Folder   |");
+                printf(" %.2d:%.2d AM ", timestamp.Hour, timestamp.Minute);
             }
+            printf(" %d/%.2d/%.2d  |", timestamp.Year, timestamp.Month, timestamp.Day);
+        }
+        else
+        {
+            /* Print an empty space if the last write date of the directory is empty */
+            printf("%*s|", 23, "");
+        }
 
-            /* Check if the last write date of the directory is not empty */
-            if (0 != (temp_DirList->data.Last_Write_Date & 0x1F))
+        /* Check if the creation date of the directory is not empty */
+        fatfs_decode_timestamp(temp_DirList->data.Creation_Date, temp_DirList->data.Creation_Time, &timestamp);
+        if (0 != timestamp.Day)
+        {
+            /* Print the creation time and date of the directory */
+            if (12 < timestamp.Hour)
             {
-                /* Print the last write time and date of the directory */
-                if (12 < ((temp_DirList->data.Last_Write_Time) >> 11))
-                {
-                    printf(" %.2d:%.2d PM ", ((temp_DirList->data.Last_Write_Time) >> 11), (((temp_DirList->data.Last_Write_Time) >> 5) & 0x3F));
-                }
-                else
-                {
-                    printf(" %.2d:%.2d AM ", ((temp_DirList->data.Last_Write_Time) >> 11), (((temp_DirList->data.Last_Write_Time) >> 5) & 0x3F));
-                }
-                printf(" %d/%.2d/%.2d  |", (((temp_DirList->data.Last_Write_Date) >> 9) + 1980), (((temp_DirList->data.Last_Write_Date) >> 5) & 0x0F), (temp_DirList->data.Last_Write_Date & 0x1F));
+                printf(" %.2d:%.2d PM ", timestamp.Hour, timestamp.Minute);
             }
             else
             {
-                /* Print an empty space if the last write date of the directory is empty */
-                printf("%*s|", 23, "");
+                printf(" %.2d:%.2d AM ", timestamp.Hour, timestamp.Minute);
             }
+            printf(" %d/%.2d/%.2d  |", timestamp.Year, timestamp.Month, timestamp.Day);
+        }
+        else
+        {
+            /* Print an empty space if the creation date of the directory is empty */
+            printf("%*s|", 23, "");
+        }
 
-            /* Check if the creation date of the directory is not empty */
-            if (0 != (temp_DirList->data.Creation_Date & 0x1F))
+        /* Check if the directory is a file */
+        if (0 == bit_checks_file_or_directory)
+        {
+            /* Print the size of the file */
+            if (1000 > temp_DirList->data.File_Size_in_bytes)
             {
-                /* Print the creation time and date of the directory */
-                if (12 < ((temp_DirList->data.Creation_Time) >> 11))
-                {
-                    printf(" %.2d:%.2d PM ", ((temp_DirList->data.Creation_Time) >> 11), (((temp_DirList->data.Creation_Time) >> 5) & 0x3F));
-                }
-                else
-                {
-                    printf(" %.2d:%.2d AM ", ((temp_DirList->data.Creation_Time) >> 11), (((temp_DirList->data.Creation_Time) >> 5) & 0x3F));
-                }
-                printf(" %d/%.2d/%.2d  |", (((temp_DirList->data.Creation_Date) >> 9) + 1980), (((temp_DirList->data.Creation_Date) >> 5) & 0x0F), (temp_DirList->data.Creation_Date & 0x1F));
+                printf(" %5u byte   |\n", temp_DirList->data.File_Size_in_bytes);
             }
-            else
+            else if (1000000 > temp_DirList->data.File_Size_in_bytes)
             {
-                /* Print an empty space if the creation date of the directory is empty */
-                printf("%*s|", 23, "");
+                printf("%8.2f KB   |\n", temp_DirList->data.File_Size_in_bytes / 1000.0);
             }
-
-            /* Check if the directory is a file */
-            if (0 == bit_checks_file_or_directory)
+            else if (1000000000 > temp_DirList->data.File_Size_in_bytes)
             {
-                /* Print the size of the file */
-                if (1000 > temp_DirList->data.File_Size_in_bytes)
-                {
-                    printf(" %5u byte   |\n", temp_DirList->data.File_Size_in_bytes);
-                }
-                else if (1000000 > temp_DirList->data.File_Size_in_bytes)
-                {
-                    printf("%8.2f KB   |\n", temp_DirList->data.File_Size_in_bytes / 1000.0);
-                }
-                else if (1000000000 > temp_DirList->data.File_Size_in_bytes)
-                {
-                    printf("%8.2f MB   |\n", temp_DirList->data.File_Size_in_bytes / 1000000.0);
-                }
-                else
-                {
-                    /* Do nothing */
-                }
+                printf("%8.2f MB   |\n", temp_DirList->data.File_Size_in_bytes / 1000000.0);
             }
             else
             {
-                /* Print an empty space if the directory is not a file */
-                printf("%*s|\n", 14, "");
+                /* Do nothing */
             }
-
-            /* Increment the serial number */
-            serial_number++;
         }
         else
         {
-            /* Do nothing */
+            /* Print an empty space if the directory is not a file */
+            printf("%*s|\n", 14, "");
         }
-
-        /* Move to the next directory in the list */
-        temp_DirList = temp_DirList->next;
     }
 
     /* Set the temporary directory list node to the head of the directory list */
-    temp_DirList = head_DirList;
+    temp_DirList = head;
 
     /* Check if the directory list is empty and the directory is not a hidden file or directory */
-    if (1 == serial_number && 1 == ((temp_DirList->data.Attributes >> 4) & 1))
+    if (1 == serial_number && (NULL == temp_DirList || 1 == ((temp_DirList->data.Attributes >> 4) & 1)))
     {
         /* Print a message indicating that the directory is empty */
         printf("\t|%*s|\n", 107, "");
@@ -184,16 +292,213 @@ void print_Dir_List(DirList *temp_DirList)
 
     /* Print the footer of the directory list */
     printf("\t+-----------------------------------------------------------------------------------------------------------+\n");
+    printf("\t|  Sort by |n| name, |x| extension, |s| size, |m| date modified, |c| date created, or |o| for disk order.   |\n");
     printf("\t|  Press |e| or |E| to exit program.                                                                        |\n");
     printf("\t+-----------------------------------------------------------------------------------------------------------+\n");
     printf("\n");
 }
 
+/*
+ * @brief Select the order of the listings.
+ * @details This function maps a sort option letter to the order of the listings and records it for read_dir_sorted.
+ * @param option - The letter typed by the user.
+ * @returns Returns 1 if the letter is a sort option, 0 otherwise.
+ */
+uint8_t select_sort_order(char option)
+{
+    uint8_t result = 1;
+    /* Default result is 1 (the letter is a sort option) */
+
+    switch (toupper((unsigned char)option))
+    {
+    case 'N':
+    {
+        sort_key = FATFS_SORT_NAME;
+        sort_enabled = 1;
+        break;
+    }
+    case 'X':
+    {
+        sort_key = FATFS_SORT_EXTENSION;
+        sort_enabled = 1;
+        break;
+    }
+    case 'S':
+    {
+        sort_key = FATFS_SORT_SIZE;
+        sort_enabled = 1;
+        break;
+    }
+    case 'M':
+    {
+        sort_key = FATFS_SORT_MODIFIED;
+        sort_enabled = 1;
+        break;
+    }
+    case 'C':
+    {
+        sort_key = FATFS_SORT_CREATED;
+        sort_enabled = 1;
+        break;
+    }
+    case 'O':
+    {
+        sort_enabled = 0;
+        break;
+    }
+    default:
+    {
+        result = 0;
+        break;
+    }
+    }
+
+    return result;
+}
+
+/*
+ * @brief Read a directory in the order chosen by the user.
+ * @details This function reads a directory list and sorts it when a sort order has been selected.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @returns Returns a pointer to the head of the directory list.
+ */
+DirList *read_dir_sorted(uint32_t First_Logical_Cluster_of_choice)
+{
+    DirList *head = fatfs_read_dir(First_Logical_Cluster_of_choice);
+    /* The head of the directory list */
+
+    /* Sort the list when the user asked for an order */
+    if (0 != sort_enabled)
+    {
+        head = fatfs_sort_dir_list(head, sort_key);
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    return head;
+}
+
+/*
+ * @brief Release every listing of the navigation cache.
+ * @details This function is called when the listings may be out of date: the image changed or the order of the listings changed.
+ * @param None.
+ * @returns None.
+ */
+void flush_navigation_cache(void)
+{
+    uint32_t i = 0;
+    /* Loop counter */
+
+    for (i = 0; i < NAVIGATION_CACHE_SLOTS; i++)
+    {
+        deallocate_Dir_List(navigation_cache[i].Listing);
+        navigation_cache[i].Listing = NULL;
+    }
+    navigation_cache_size = 0;
+}
+
+/*
+ * @brief Open a directory through the navigation cache.
+ * @details This function returns the kept listing of a directory visited recently, and reads it with read_dir_sorted otherwise.
+ *               The listing read is kept, after the least recently shown listings have been released to stay within the budget.
+ *               The listings belong to the cache and must not be deallocated by the caller.
+ * @param First_Logical_Cluster_of_choice - The first logical cluster of the directory, 0 for the root directory.
+ * @returns Returns a pointer to the head of the directory list.
+ */
+DirList *open_directory(uint32_t First_Logical_Cluster_of_choice)
+{
+    DirList *head = NULL;
+    /* The head of the directory list */
+    DirList *node = NULL;
+    /* A node of the directory list */
+    navigation_cache_struct_t *slot = NULL;
+    /* The slot holding the directory */
+    navigation_cache_struct_t *victim = NULL;
+    /* The least recently shown listing, released to make room */
+    uint32_t size = 0;
+    /* The number of bytes the listing uses */
+    uint32_t i = 0;
+    /* Loop counter */
+
+    navigation_clock++;
+
+    for (i = 0; i < NAVIGATION_CACHE_SLOTS && NULL == slot; i++)
+    {
+        if (NULL != navigation_cache[i].Listing && First_Logical_Cluster_of_choice == navigation_cache[i].First_cluster)
+        {
+            slot = &navigation_cache[i];
+        }
+        else
+        {
+            /* Do nothing */
+        }
+    }
+
+    if (NULL == slot)
+    {
+        head = read_dir_sorted(First_Logical_Cluster_of_choice);
+        for (node = head; NULL != node; node = node->next)
+        {
+            size += sizeof(DirList) + ((NULL != node->data.Long_name) ? strlen(node->data.Long_name) + 1 : 0);
+        }
+
+        /* Release the least recently shown listings until the new one fits in a free slot and in the budget */
+        do
+        {
+            slot = NULL;
+            victim = NULL;
+            for (i = 0; i < NAVIGATION_CACHE_SLOTS; i++)
+            {
+                if (NULL == navigation_cache[i].Listing)
+                {
+                    slot = &navigation_cache[i];
+                }
+                else if (NULL == victim || navigation_cache[i].Last_used < victim->Last_used)
+                {
+                    victim = &navigation_cache[i];
+                }
+                else
+                {
+                    /* Do nothing */
+                }
+            }
+
+            if (NULL != victim && (NULL == slot || NAVIGATION_CACHE_BUDGET < navigation_cache_size + size))
+            {
+                deallocate_Dir_List(victim->Listing);
+                victim->Listing = NULL;
+                navigation_cache_size -= victim->Size;
+                slot = NULL;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        } while (NULL == slot);
+
+        /* A listing larger than the budget is still kept while it is shown, and is the first one released */
+        slot->Listing = head;
+        slot->First_cluster = First_Logical_Cluster_of_choice;
+        slot->Size = size;
+        navigation_cache_size += size;
+    }
+    else
+    {
+        /* Do nothing */
+    }
+
+    slot->Last_used = navigation_clock;
+
+    return slot->Listing;
+}
+
 /*
  * @brief Get user input.
  * @details This function prompts the user for an input number within a valid range and validates it. It handles empty, non-numeric, and out-of-range inputs, providing appropriate prompts and error messages.
  * @param serial_number - The maximum valid input number allowed.
- * @returns The user's valid input number or triggers program exit if 'e' or 'E' is entered.
+ * @returns The user's valid input number or triggers program exit if 'e' or 'E' is entered. A sort option letter sets sort_requested.
  */
 uint16_t get_input(uint16_t serial_number)
 {
@@ -224,6 +529,21 @@ uint16_t get_input(uint16_t serial_number)
         {
             exit_program = 1;
         }
+        /* Check if the user chose a sort order */
+        else if (0 != select_sort_order(input[0]))
+        {
+            sort_requested = 1;
+            /* Clear the input buffer */
+            if ('\n' != input[strlen(input) - 1])
+            {
+                while ('\n' != getchar())
+                    ;
+            }
+            else
+            {
+                /* Do nothing */
+            }
+        }
         else
         {
             /* Remove the newline character from the end of the input */
@@ -315,7 +635,7 @@ uint16_t get_input(uint16_t serial_number)
 
 /*
  * @brief Print an error message.
- * @details This function prints a specific error message based on the provided error code. It covers various error scenarios such as file opening, boot sector reading, memory allocation, sector size updating, and directory reading errors.
+ * @details This function prints a specific error message based on the provided error code. It covers various error scenarios such as file opening, boot sector reading and validation, memory allocation, sector size updating, and directory reading errors.
  * @param err - The error code that determines the message to be printed.
  * @returns None. This function outputs error messages to the console.
  */
@@ -372,12 +692,19 @@ void print_error(ERROR_CODE err)
         printf("Failed to read Subdirectory !\n");
         break;
     }
+    /* If the boot sector does not describe a valid FAT volume */
+    case INVALID_BOOT_SECTOR:
+    {
+        printf("The boot sector is invalid !\n");
+        break;
+    }
     }
 }
 
 /*
  * @brief Main function to initialize the FAT file system, read directories and files, and handle user input.
  * @details This function initializes the FAT file system, reads directories and files, and handles user input.
+ *               Directories visited recently are kept by the navigation cache, and are read again whenever the image changes underneath the session.
  *               It continuously prompts the user for input to navigate directories or exit the program.
  *               It also manages memory allocation for the buffer and handles errors by calling an error callback function.
  *               Upon exiting, it deallocates any allocated memory and de-initializes the FAT file system.
@@ -390,10 +717,8 @@ int main(void)
     /* Variable to store the cluster size */
     uint8_t bit_checks_file_or_directory = 0;
     /* Variable to check if it's a file or directory */
-    uint16_t First_Logical_Cluster_of_choice = 0;
+    uint32_t First_Logical_Cluster_of_choice = 0;
     /* Variable to store the first logical cluster of choice */
-    uint16_t count = 1;
-    /* Variable to store the count */
     uint32_t i = 0;
     /* Loop counter */
     static ClusterList *head_cluster_list = NULL;
@@ -404,6 +729,8 @@ int main(void)
     /* Temporary variable for a directory list node */
     uint16_t choice = 0;
     /* Variable to store the user's choice */
+    uint32_t Current_directory_cluster = 0;
+    /* Variable to store the first logical cluster of the directory being shown */
 
     /* Initialize the FAT file system with the given path and error callback function */
     Cluster_size = fatfs_init("floppy.img", print_error);
@@ -412,132 +739,114 @@ int main(void)
     if (0 != Cluster_size)
     {
         /* Read the root directory at the first logical cluster of choice */
-        head_DirList = fatfs_read_dir(First_Logical_Cluster_of_choice);
+        head_DirList = open_directory(First_Logical_Cluster_of_choice);
         /* Loop until the user chooses to exit the program */
         do
         {
-            /* Set the temporary directory list node to the head of the directory list */
-            temp_DirList = head_DirList;
-            print_Dir_List(temp_DirList);
-            temp_DirList = head_DirList;
+            /* Read the current directory again if the image changed since it was listed */
+            if (0 != fatfs_check_for_changes())
+            {
+                flush_navigation_cache();
+                head_DirList = open_directory(Current_directory_cluster);
+            }
+            else
+            {
+                /* Do nothing */
+            }
+
+            /* Number the entries once, then print them and map the user's choice to its entry */
+            build_option_table(head_DirList);
+            print_Dir_List(head_DirList);
             /* Get the user's choice */
             choice = get_input(serial_number);
 
             /* Check if the user chose to exit the program */
             if (1 != exit_program)
             {
-                /* Check if the user chose the root directory and it's not a hidden file or directory */
-                if (0 == choice && '.' != temp_DirList->data.File_name[0])
+                /* Check if the user chose a new order, in which case the current directory is listed again */
+                if (0 != sort_requested)
+                {
+                    sort_requested = 0;
+                    flush_navigation_cache();
+                    head_DirList = open_directory(Current_directory_cluster);
+                }
+                /* Option 0 returns to the root directory when the directory shown has no ".." entry */
+                else if (NULL == option_table || NULL == option_table[choice])
                 {
-                    /* Deallocate the directory list */
-                    deallocate_Dir_List(head_DirList);
-                    head_DirList = NULL;
-                    /* Read the root directory */
-                    head_DirList = fatfs_read_dir(0);
+                    /* Open the root directory */
+                    head_DirList = open_directory(0);
+                    Current_directory_cluster = 0;
                 }
                 else
                 {
-                    /* Check if the user chose the root directory */
-                    if (0 == choice)
+                    /* Get the chosen entry from the entry table */
+                    temp_DirList = option_table[choice];
+
+                    printf("\n\tFile name: %s %s", temp_DirList->data.File_name, temp_DirList->data.Extension);
+                    /* The long file name does not fit in the table, so it is shown here */
+                    if (NULL != temp_DirList->data.Long_name)
                     {
-                        printf("\n\tFile name: %s %s\n\n", temp_DirList->data.File_name, temp_DirList->data.Extension);
-                        /* Get the first logical cluster of the chosen directory */
-                        First_Logical_Cluster_of_choice = head_DirList->data.First_Logical_Cluster;
-                        /* Deallocate the directory list */
-                        deallocate_Dir_List(head_DirList);
-                        head_DirList = NULL;
-                        /* Read the directory at the first logical cluster of choice */
-                        head_DirList = fatfs_read_dir(First_Logical_Cluster_of_choice);
-                        /* Reset the count and serial number */
-                        count = 1;
-                        serial_number = 1;
+                        printf(" (%s)", temp_DirList->data.Long_name);
                     }
                     else
                     {
-                        /* Check if the chosen directory is a hidden file or directory */
-                        if ('.' == temp_DirList->data.File_name[0])
-                        {
-                            /* Increment the user's choice */
-                            choice++;
-                        }
-                        else
-                        {
-                            /* Do nothing */
-                        }
-
-                        /* Set the temporary directory list node to the head of the directory list */
-                        temp_DirList = head_DirList;
-
-                        /* Loop until the chosen directory is reached */
-                        while (NULL != temp_DirList && count < choice)
-                        {
-                            /* Move to the next directory in the list */
-                            temp_DirList = temp_DirList->next;
-                            /* Increment the count */
-                            count++;
-                        }
-
-                        printf("\n\tFile name: %s %s\n\n", temp_DirList->data.File_name, temp_DirList->data.Extension);
-                        /* Get the bit that checks if the chosen directory is a file or directory */
-                        bit_checks_file_or_directory = (temp_DirList->data.Attributes >> 4) & 1;
-                        /* Get the first logical cluster of the chosen directory */
-                        First_Logical_Cluster_of_choice = temp_DirList->data.First_Logical_Cluster;
+                        /* Do nothing */
+                    }
+                    printf("\n\n");
+                    /* Get the bit that checks if the chosen directory is a file or directory */
+                    bit_checks_file_or_directory = (temp_DirList->data.Attributes >> 4) & 1;
+                    /* Get the first logical cluster of the chosen directory */
+                    First_Logical_Cluster_of_choice = temp_DirList->data.First_Logical_Cluster;
+
+                    /* Check if the chosen directory is a file */
+                    if (0 == bit_checks_file_or_directory)
+                    {
+                        /* Read the file at the first logical cluster of choice */
+                        head_cluster_list = fatfs_read_file(First_Logical_Cluster_of_choice);
+                        /* Set the temporary cluster list node to the head of the cluster list */
+                        temp_cluster_list = head_cluster_list;
 
-                        /* Check if the chosen directory is a file */
-                        if (0 == bit_checks_file_or_directory)
+                        printf("\t");
+                        while (NULL != temp_cluster_list)
                         {
-                            /* Read the file at the first logical cluster of choice */
-                            head_cluster_list = fatfs_read_file(First_Logical_Cluster_of_choice);
-                            /* Set the temporary cluster list node to the head of the cluster list */
-                            temp_cluster_list = head_cluster_list;
-
-                            printf("\t");
-                            while (NULL != temp_cluster_list)
+                            for (i = 0; i < temp_cluster_list->number_of_bytes; i++)
                             {
-                                for (i = 0; i < Cluster_size; i++)
-                                {
-                                    printf("%c", temp_cluster_list->data_in_cluster[i]);
-                                }
-
-                                /* Move to the next cluster in the list */
-                                temp_cluster_list = temp_cluster_list->next;
+                                printf("%c", temp_cluster_list->data_in_cluster[i]);
                             }
 
-                            /* Deallocate the cluster list */
-                            deallocate_Cluster_List(head_cluster_list);
-                            /* Reset the head of the cluster list */
-                            head_cluster_list = NULL;
-                        }
-                        else
-                        {
-                            /* Deallocate the directory list */
-                            deallocate_Dir_List(head_DirList);
-                            /* Reset the head of the directory list */
-                            head_DirList = NULL;
-                            /* Read the directory at the first logical cluster of choice */
-                            head_DirList = fatfs_read_dir(First_Logical_Cluster_of_choice);
+                            /* Move to the next cluster in the list */
+                            temp_cluster_list = temp_cluster_list->next;
                         }
 
-                        /* Reset the count and serial number */
-                        count = 1;
-                        serial_number = 1;
+                        /* Deallocate the cluster list */
+                        deallocate_Cluster_List(head_cluster_list);
+                        /* Reset the head of the cluster list */
+                        head_cluster_list = NULL;
+                    }
+                    else
+                    {
+                        /* Open the directory at the first logical cluster of choice */
+                        head_DirList = open_directory(First_Logical_Cluster_of_choice);
+                        Current_directory_cluster = First_Logical_Cluster_of_choice;
                     }
                 }
                 printf("\n");
             }
             else
             {
-                /* Deallocate the directory list */
-                deallocate_Dir_List(head_DirList);
+                /* Deallocate the directory lists */
+                flush_navigation_cache();
+                head_DirList = NULL;
+                /* Deallocate the entry table */
+                free(option_table);
+                option_table = NULL;
+                option_table_capacity = 0;
                 /* De-initialize the FAT file system */
                 fatfs_de_init();
                 /* Print a message indicating that the program has exited */
                 printf("\n\tThe program has exited. Thank you for using :) \n");
             }
 
-            /* Reset the serial number */
-            serial_number = 1;
-
             /* Continue looping until the user chooses to exit the program */
         } while (1 != exit_program);
     }